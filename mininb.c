@@ -34,6 +34,8 @@
 
 #include "nb_random.h"
 #include "nb_engine.h"
+#include "nb_report.h"
+#include "nb_time.h"
 
 static int
 action_get(struct nb_opts *opts)
@@ -47,16 +49,66 @@ action_put(struct nb_opts *opts)
 	return nb_engine_run(opts, NB_BENCH_PUT);
 }
 
+static int
+action_scan(struct nb_opts *opts)
+{
+	return nb_engine_run(opts, NB_BENCH_SCAN);
+}
+
+static int
+action_mixed(struct nb_opts *opts)
+{
+	return nb_engine_run(opts, NB_BENCH_MIXED);
+}
+
+static int
+action_delete(struct nb_opts *opts)
+{
+	return nb_engine_run(opts, NB_BENCH_DELETE);
+}
+
+static int
+action_churn(struct nb_opts *opts)
+{
+	return nb_engine_run(opts, NB_BENCH_CHURN);
+}
+
+static int
+action_merge(struct nb_opts *opts)
+{
+	return nb_report_merge(opts);
+}
+
 static int
 action_shuffle(struct nb_opts *opts)
 {
+	if (opts->key_format != NB_KEY_FILE) {
+		fprintf(stderr, "Generated keys can't be shuffled, "
+			"use --distribution instead\n");
+		return -1;
+	}
+
+	/* Records are as long as the longest key, the same as the engine */
+	struct nb_random_sizes key_sizes;
+	memset(&key_sizes, 0, sizeof(key_sizes));
+	key_sizes.type = opts->key_size;
+	key_sizes.min = opts->key_len_min;
+	key_sizes.max = opts->key_len;
+	key_sizes.theta = opts->zipf_theta;
+	key_sizes.filename = opts->key_sizes;
+	key_sizes.name = "key";
+	if (nb_random_sizes_create(&key_sizes) != 0)
+		return -1;
+	size_t record_size = key_sizes.max;
+	nb_random_sizes_destroy(&key_sizes);
+
 	fprintf(stderr, "Shuffling file...");
-	int r = nb_random_shuffle(opts->keys_filename,
-				  opts->key_len, opts->count);
+	int r = nb_random_shuffle(opts->keys_filename, record_size,
+				  opts->count, opts->seed, opts->threads);
 	if (r != 0) {
 		return -1;
 	}
-	fprintf(stderr, "\r" "Shuffling file..." " " "ok" "\n");
+	fprintf(stderr, "\r" "Shuffling file..." " " "ok" "%20s" "\n", "");
 
 	return 0;
 }
@@ -68,18 +120,88 @@ static struct action {
 } ACTIONS[] = {
 	{ action_get,     "get",      "GET benchmark"},
 	{ action_put,     "put",      "PUT benchmark"},
-	{ action_shuffle, "shuffle",  "Shuffle keys file"},
+	{ action_scan,    "scan",     "Range scan benchmark"},
+	{ action_mixed,   "mixed",    "Mixed GET/PUT/SCAN benchmark"},
+	{ action_delete,  "delete",   "DELETE benchmark"},
+	{ action_churn,   "churn",    "Delete old and insert new keys"},
+	{ action_merge,   "merge",    "Merge histogram files given as "
+				      "arguments"},
+	{ action_shuffle, "shuffle",  "Shuffle keys file (needs free disk "
+				      "space for a copy of it)"},
 	{ NULL,           NULL,       NULL }
 };
 
+enum {
+	OPT_RATE = 256,
+	OPT_READ_RATIO,
+	OPT_UPDATE_RATIO,
+	OPT_SCAN_RATIO,
+	OPT_SCAN_LENGTH,
+	OPT_BATCH,
+	OPT_CHURN_OPS,
+	OPT_QUEUE_DEPTH,
+	OPT_DURATION,
+	OPT_WARMUP,
+	OPT_WARMUP_OPS,
+	OPT_SAMPLES,
+	OPT_SAMPLE_INTERVAL,
+	OPT_SEED,
+	OPT_HISTOGRAM_DIGITS,
+	OPT_HISTOGRAM_OUT,
+	OPT_DISTRIBUTION,
+	OPT_ZIPF_THETA,
+	OPT_HOT_KEYS,
+	OPT_HOT_OPS,
+	OPT_KEY_FORMAT,
+	OPT_READ_ORDER,
+	OPT_VALUE_SIZE,
+	OPT_VLEN_MIN,
+	OPT_VALUE_SIZES,
+	OPT_COMPRESSION_RATIO,
+	OPT_KEY_SIZE,
+	OPT_KLEN_MIN,
+	OPT_KEY_SIZES,
+	OPT_VERIFY,
+	OPT_SELECT_INTO,
+	OPT_TIMER,
+	OPT_TIMER_SUBTRACT,
+	OPT_PERF_COUNTERS,
+	OPT_IO_STATS,
+	OPT_MEMORY_STATS,
+	OPT_CPUS,
+	OPT_NUMA_POLICY,
+	OPT_SHARDS,
+	OPT_SHARD_THREADS,
+};
+
 struct nb_opts opts = {
 	.path   = "./nb",
 	.driver = "leveldb",
 	.keys_filename = "keys.bin",
 	.key_len = 16,
+	.key_len_min = 0,
+	.key_size = NB_SIZE_FIXED,
 	.val_len = 100,
+	.val_len_min = 1,
+	.value_size = NB_SIZE_FIXED,
+	.compression_ratio = 0.5,
 	.report_interval = 10000,
 	.count = 100000,
+	.threads = 1,
+	.read_ratio = 0.95,
+	.update_ratio = 0.05,
+	.scan_ratio = 0.0,
+	.scan_length = 100,
+	.batch = 1,
+	.shards = 1,
+	.sample_interval = 1.0,
+	.seed = 1,
+	.hist_digits = 3,
+	.key_format = NB_KEY_FILE,
+	.distribution = NB_RANDOM_SEQUENTIAL,
+	.zipf_theta = 0.99,
+	.hot_keys = 0.2,
+	.hot_ops = 0.8,
 };
 
 void
@@ -107,12 +229,121 @@ usage(void) {
 		opts.key_len);
 	fprintf(stderr, "\t--vlen=%zu - value length in bytes\n",
 		opts.val_len);
+	fprintf(stderr, "\t--key-size=");
+	for (int i = 0; i < NB_SIZE_MAX; i++) {
+		fprintf(stderr, "%s%s", i > 0 ? "|" : "",
+			nb_size_type_names[i]);
+	}
+	fprintf(stderr, " - distribution of key sizes in [--klen-min, "
+		"--klen]\n");
+	fprintf(stderr, "\t--klen-min=%zu - minimal key length in bytes, "
+		"0 - same as --klen\n", opts.key_len_min);
+	fprintf(stderr, "\t--key-sizes=FILE - 'size weight' lines for "
+		"empirical key sizes\n");
+	fprintf(stderr, "\t--value-size=");
+	for (int i = 0; i < NB_SIZE_MAX; i++) {
+		fprintf(stderr, "%s%s", i > 0 ? "|" : "",
+			nb_size_type_names[i]);
+	}
+	fprintf(stderr, " - distribution of value sizes in [--vlen-min, "
+		"--vlen]\n");
+	fprintf(stderr, "\t--vlen-min=%zu - minimal value length in bytes\n",
+		opts.val_len_min);
+	fprintf(stderr, "\t--value-sizes=FILE - 'size weight' lines for "
+		"empirical value sizes\n");
+	fprintf(stderr, "\t--compression-ratio=%.2lf - compressed / raw size "
+		"of values\n", opts.compression_ratio);
 	fprintf(stderr, "\t--keys=%s - path to a binary file with keys\n",
 		opts.keys_filename);
 	fprintf(stderr, "\t--report-interval=%zu - report interval (records)\n",
 		opts.report_interval);
 	fprintf(stderr, "\t--count=%zu - number of records\n",
 		opts.count);
+	fprintf(stderr, "\t--threads=%zu - number of benchmark threads\n",
+		opts.threads);
+	fprintf(stderr, "\t--rate=%zu - issue ops at a fixed rate (ops/sec), "
+		"0 - as fast as possible\n", opts.rate);
+	fprintf(stderr, "\t--read-ratio=%.2lf - proportion of GET operations "
+		"(mixed)\n", opts.read_ratio);
+	fprintf(stderr, "\t--update-ratio=%.2lf - proportion of PUT "
+		"operations (mixed)\n", opts.update_ratio);
+	fprintf(stderr, "\t--scan-ratio=%.2lf - proportion of range scans "
+		"(mixed)\n", opts.scan_ratio);
+	fprintf(stderr, "\t--scan-length=%zu - number of records read by "
+		"a range scan\n", opts.scan_length);
+	fprintf(stderr, "\t--batch=%zu - number of records in a write "
+		"batch\n", opts.batch);
+	fprintf(stderr, "\t--churn-ops=%zu - number of delete/insert pairs "
+		"(churn), 0 - same as --count\n", opts.churn_ops);
+	fprintf(stderr, "\t--queue-depth=%zu - number of asynchronous "
+		"requests in flight per thread, 0 - synchronous\n",
+		opts.queue_depth);
+	fprintf(stderr, "\t--duration=%.1lf - run time limit (sec), "
+		"0 - until --count keys are used\n", opts.duration);
+	fprintf(stderr, "\t--warmup=%.1lf - warm-up time (sec), not "
+		"reported\n", opts.warmup);
+	fprintf(stderr, "\t--warmup-ops=%zu - number of warm-up ops, not "
+		"reported\n", opts.warmup_ops);
+	fprintf(stderr, "\t--samples=FILE - write per-interval samples to "
+		"a CSV file or JSON lines (*.json)\n");
+	fprintf(stderr, "\t--sample-interval=%.1lf - sample interval (sec)\n",
+		opts.sample_interval);
+	fprintf(stderr, "\t--seed=%llu - seed for random number generators\n",
+		(unsigned long long) opts.seed);
+	fprintf(stderr, "\t--histogram-digits=%d - significant digits of "
+		"latency histograms (1-5)\n", opts.hist_digits);
+	fprintf(stderr, "\t--histogram-out=FILE - save latency histograms "
+		"to a file for the merge action\n");
+	fprintf(stderr, "\t--timer=");
+	for (int i = 0; i < NB_TIMER_MAX; i++) {
+		fprintf(stderr, "%s%s", i > 0 ? "|" : "",
+			nb_timer_type_names[i]);
+	}
+	fprintf(stderr, " - source of timestamps, auto - invariant TSC "
+		"if available\n");
+	fprintf(stderr, "\t--timer-subtract - subtract the cost of reading "
+		"the timer from latencies\n");
+	fprintf(stderr, "\t--perf-counters - count CPU cycles, instructions, "
+		"cache, branch and TLB misses and page faults per op\n");
+	fprintf(stderr, "\t--io-stats - report device I/O of the process, "
+		"write, read and space amplification\n");
+	fprintf(stderr, "\t--memory-stats - report RSS, its peak, anonymous "
+		"and file-backed parts and page faults\n");
+	fprintf(stderr, "\t--cpus=LIST - run worker threads on CPUs of the "
+		"list (e.g. 0-3,8), one CPU per thread\n");
+	fprintf(stderr, "\t--numa-policy=local|interleave|node:N - place "
+		"memory on the local node, all nodes or node N\n");
+	fprintf(stderr, "\t--shards=%zu - number of databases in "
+		"<path>/<driver>/shard-K, keys are routed by hash\n",
+		opts.shards);
+	fprintf(stderr, "\t--shard-threads - every thread serves keys of "
+		"one shard only (thread i - shard i %% shards)\n");
+	fprintf(stderr, "\t--key-format=");
+	for (int i = 0; i < NB_KEY_MAX; i++) {
+		fprintf(stderr, "%s%s", i > 0 ? "|" : "",
+			nb_key_format_names[i]);
+	}
+	fprintf(stderr, " - read keys from --keys file or generate them "
+		"from --seed\n");
+	fprintf(stderr, "\t--verify - GET values and check them against the "
+		"values written by PUT with the same --seed\n");
+	fprintf(stderr, "\t--select-into - GET values into a preallocated "
+		"buffer instead of memory allocated by the driver\n");
+	fprintf(stderr, "\t--read-order=insert|permuted - read keys in the "
+		"order of the file or in a permutation of --seed\n");
+	fprintf(stderr, "\t--distribution=");
+	for (int i = 0; i < NB_RANDOM_MAX; i++) {
+		fprintf(stderr, "%s%s", i > 0 ? "|" : "",
+			nb_random_type_names[i]);
+	}
+	fprintf(stderr, " - distribution of keys over the first --count "
+		"keys, sequential - every key once in file order\n");
+	fprintf(stderr, "\t--zipf-theta=%.2lf - skew of zipfian and latest "
+		"distributions\n", opts.zipf_theta);
+	fprintf(stderr, "\t--hot-keys=%.2lf - proportion of hot keys "
+		"(hotspot)\n", opts.hot_keys);
+	fprintf(stderr, "\t--hot-ops=%.2lf - proportion of ops on hot keys "
+		"(hotspot)\n", opts.hot_ops);
 
 	fprintf(stderr, "\n\n");
 	fprintf(stderr, "Example:\n");
@@ -120,8 +351,64 @@ usage(void) {
 	fprintf(stderr, "./mininb --count=1000000 --action=put\n");
 	fprintf (stderr, "# Shuffle keys\n");
 	fprintf(stderr, "./mininb --count=1000000 --action=shuffle\n");
+	fprintf (stderr, "# Shuffle keys using 8 threads\n");
+	fprintf(stderr, "./mininb --count=1000000 --action=shuffle "
+		"--threads=8 --seed=2\n");
 	fprintf (stderr, "# Benchmark GET operation\n");
 	fprintf(stderr, "./mininb --count=1000000 --action=get\n");
+	fprintf (stderr, "# Benchmark GET operation in a random order without "
+		 "shuffling\n");
+	fprintf(stderr, "./mininb --count=1000000 --action=get "
+		"--read-order=permuted --seed=7\n");
+	fprintf (stderr, "# Check every value loaded by a PUT run\n");
+	fprintf(stderr, "./mininb --count=1000000 --action=get --verify\n");
+	fprintf (stderr, "# Benchmark GET operation using 8 threads\n");
+	fprintf(stderr, "./mininb --count=1000000 --action=get --threads=8\n");
+	fprintf (stderr, "# Benchmark 95%% GET and 5%% PUT operations\n");
+	fprintf(stderr, "./mininb --count=1000000 --action=mixed "
+		"--read-ratio=0.95 --update-ratio=0.05\n");
+	fprintf (stderr, "# Benchmark PUT operation with 8-200 byte keys\n");
+	fprintf(stderr, "./mininb --count=1000000 --action=put "
+		"--key-size=uniform --klen-min=8 --klen=200\n");
+	fprintf (stderr, "# Benchmark PUT operation with 100-4000 byte values "
+		 "compressible 2:1\n");
+	fprintf(stderr, "./mininb --count=1000000 --action=put "
+		"--value-size=uniform --vlen-min=100 --vlen=4000 "
+		"--compression-ratio=0.5\n");
+	fprintf (stderr, "# Benchmark PUT operation in batches of 100 records\n");
+	fprintf(stderr, "./mininb --count=1000000 --action=put --batch=100\n");
+	fprintf (stderr, "# Benchmark GET operation with 32 requests in flight\n");
+	fprintf(stderr, "./mininb --count=1000000 --action=get "
+		"--queue-depth=32\n");
+	fprintf (stderr, "# Replace all keys of a live set of 1000000 keys\n");
+	fprintf(stderr, "./mininb --count=1000000 --action=put\n");
+	fprintf(stderr, "./mininb --count=1000000 --action=churn "
+		"--churn-ops=1000000\n");
+	fprintf (stderr, "# Benchmark range scans of 50 records\n");
+	fprintf(stderr, "./mininb --count=100000 --action=scan "
+		"--scan-length=50\n");
+	fprintf (stderr, "# Benchmark GET operation for 60 seconds after "
+		 "10 seconds of warm-up\n");
+	fprintf(stderr, "./mininb --count=1000000 --action=get "
+		"--duration=60 --warmup=10\n");
+	fprintf (stderr, "# Write throughput and percentiles every second\n");
+	fprintf(stderr, "./mininb --count=1000000 --action=put "
+		"--samples=put.csv\n");
+	fprintf (stderr, "# Benchmark PUT and GET without a keys file\n");
+	fprintf(stderr, "./mininb --count=1000000 --action=put "
+		"--key-format=binary --seed=42\n");
+	fprintf(stderr, "./mininb --count=1000000 --action=get "
+		"--key-format=binary --seed=42 --distribution=uniform\n");
+	fprintf (stderr, "# Benchmark GET operation with zipfian key "
+		 "popularity\n");
+	fprintf(stderr, "./mininb --count=1000000 --action=get "
+		"--distribution=zipfian --zipf-theta=0.99\n");
+	fprintf (stderr, "# Merge latency distributions of several hosts\n");
+	fprintf(stderr, "./mininb --count=1000000 --action=get "
+		"--histogram-out=host1.hist\n");
+	fprintf(stderr, "./mininb --action=merge host1.hist host2.hist\n");
+	fprintf (stderr, "# Benchmark GET operation at 50000 ops/sec\n");
+	fprintf(stderr, "./mininb --count=1000000 --action=get --rate=50000\n");
 }
 
 int
@@ -136,6 +423,47 @@ main(int argc, char *argv[])
 		{"keys",                required_argument, NULL, 'i'},
 		{"report-interval",     required_argument, NULL, 'r'},
 		{"count",               required_argument, NULL, 'c'},
+		{"threads",             required_argument, NULL, 't'},
+		{"rate",                required_argument, NULL, OPT_RATE},
+		{"read-ratio",          required_argument, NULL, OPT_READ_RATIO},
+		{"update-ratio",        required_argument, NULL, OPT_UPDATE_RATIO},
+		{"scan-ratio",          required_argument, NULL, OPT_SCAN_RATIO},
+		{"scan-length",         required_argument, NULL, OPT_SCAN_LENGTH},
+		{"batch",               required_argument, NULL, OPT_BATCH},
+		{"churn-ops",           required_argument, NULL, OPT_CHURN_OPS},
+		{"queue-depth",         required_argument, NULL, OPT_QUEUE_DEPTH},
+		{"duration",            required_argument, NULL, OPT_DURATION},
+		{"warmup",              required_argument, NULL, OPT_WARMUP},
+		{"warmup-ops",          required_argument, NULL, OPT_WARMUP_OPS},
+		{"samples",             required_argument, NULL, OPT_SAMPLES},
+		{"sample-interval",     required_argument, NULL, OPT_SAMPLE_INTERVAL},
+		{"seed",                required_argument, NULL, OPT_SEED},
+		{"histogram-digits",    required_argument, NULL, OPT_HISTOGRAM_DIGITS},
+		{"histogram-out",       required_argument, NULL, OPT_HISTOGRAM_OUT},
+		{"timer",               required_argument, NULL, OPT_TIMER},
+		{"timer-subtract",      no_argument,       NULL, OPT_TIMER_SUBTRACT},
+		{"perf-counters",       no_argument,       NULL, OPT_PERF_COUNTERS},
+		{"io-stats",            no_argument,       NULL, OPT_IO_STATS},
+		{"memory-stats",        no_argument,       NULL, OPT_MEMORY_STATS},
+		{"cpus",                required_argument, NULL, OPT_CPUS},
+		{"numa-policy",         required_argument, NULL, OPT_NUMA_POLICY},
+		{"shards",              required_argument, NULL, OPT_SHARDS},
+		{"shard-threads",       no_argument,       NULL, OPT_SHARD_THREADS},
+		{"distribution",        required_argument, NULL, OPT_DISTRIBUTION},
+		{"zipf-theta",          required_argument, NULL, OPT_ZIPF_THETA},
+		{"hot-keys",            required_argument, NULL, OPT_HOT_KEYS},
+		{"hot-ops",             required_argument, NULL, OPT_HOT_OPS},
+		{"key-format",          required_argument, NULL, OPT_KEY_FORMAT},
+		{"read-order",          required_argument, NULL, OPT_READ_ORDER},
+		{"verify",              no_argument,       NULL, OPT_VERIFY},
+		{"select-into",         no_argument,       NULL, OPT_SELECT_INTO},
+		{"key-size",            required_argument, NULL, OPT_KEY_SIZE},
+		{"klen-min",            required_argument, NULL, OPT_KLEN_MIN},
+		{"key-sizes",           required_argument, NULL, OPT_KEY_SIZES},
+		{"value-size",          required_argument, NULL, OPT_VALUE_SIZE},
+		{"vlen-min",            required_argument, NULL, OPT_VLEN_MIN},
+		{"value-sizes",         required_argument, NULL, OPT_VALUE_SIZES},
+		{"compression-ratio",   required_argument, NULL, OPT_COMPRESSION_RATIO},
 		{0,                     0,                 0,     0 }
 	};
 
@@ -144,7 +472,7 @@ main(int argc, char *argv[])
 	while (1) {
 		int option_index = 0;
 
-		int c = getopt_long(argc, argv, "a:p:d:k:v:i:r:c:",
+		int c = getopt_long(argc, argv, "a:p:d:k:v:i:r:c:t:",
 				    options, &option_index);
 		if (c == -1)
 			break;
@@ -179,6 +507,208 @@ main(int argc, char *argv[])
 		case 'c':
 			opts.count = atol(optarg);
 			break;
+		case 't':
+			opts.threads = atol(optarg);
+			break;
+		case OPT_RATE:
+			opts.rate = atol(optarg);
+			break;
+		case OPT_READ_RATIO:
+			opts.read_ratio = atof(optarg);
+			break;
+		case OPT_UPDATE_RATIO:
+			opts.update_ratio = atof(optarg);
+			break;
+		case OPT_SCAN_RATIO:
+			opts.scan_ratio = atof(optarg);
+			break;
+		case OPT_SCAN_LENGTH:
+			opts.scan_length = atol(optarg);
+			break;
+		case OPT_BATCH:
+			opts.batch = atol(optarg);
+			break;
+		case OPT_CHURN_OPS:
+			opts.churn_ops = atol(optarg);
+			break;
+		case OPT_QUEUE_DEPTH:
+			opts.queue_depth = atol(optarg);
+			break;
+		case OPT_DURATION:
+			opts.duration = atof(optarg);
+			break;
+		case OPT_WARMUP:
+			opts.warmup = atof(optarg);
+			break;
+		case OPT_WARMUP_OPS:
+			opts.warmup_ops = atol(optarg);
+			break;
+		case OPT_SAMPLES:
+			opts.samples = optarg;
+			break;
+		case OPT_SAMPLE_INTERVAL:
+			opts.sample_interval = atof(optarg);
+			break;
+		case OPT_SEED:
+			opts.seed = strtoull(optarg, NULL, 0);
+			break;
+		case OPT_HISTOGRAM_DIGITS:
+			opts.hist_digits = atoi(optarg);
+			break;
+		case OPT_HISTOGRAM_OUT:
+			opts.histogram_out = optarg;
+			break;
+		case OPT_DISTRIBUTION: {
+			int i = 0;
+			while (i < NB_RANDOM_MAX &&
+			       strcmp(nb_random_type_names[i], optarg) != 0)
+				i++;
+			if (i == NB_RANDOM_MAX) {
+				fprintf(stderr, "Invalid distribution: %s\n",
+					optarg);
+				usage();
+				return -1;
+			}
+			opts.distribution = (enum nb_random_type) i;
+			break;
+		}
+		case OPT_KEY_FORMAT: {
+			int i = 0;
+			while (i < NB_KEY_MAX &&
+			       strcmp(nb_key_format_names[i], optarg) != 0)
+				i++;
+			if (i == NB_KEY_MAX) {
+				fprintf(stderr, "Invalid key format: %s\n",
+					optarg);
+				usage();
+				return -1;
+			}
+			opts.key_format = (enum nb_key_format) i;
+			break;
+		}
+		case OPT_KEY_SIZE: {
+			int i = 0;
+			while (i < NB_SIZE_MAX &&
+			       strcmp(nb_size_type_names[i], optarg) != 0)
+				i++;
+			if (i == NB_SIZE_MAX) {
+				fprintf(stderr, "Invalid key size: %s\n",
+					optarg);
+				usage();
+				return -1;
+			}
+			opts.key_size = (enum nb_size_type) i;
+			break;
+		}
+		case OPT_KLEN_MIN:
+			opts.key_len_min = atol(optarg);
+			break;
+		case OPT_KEY_SIZES:
+			opts.key_sizes = optarg;
+			opts.key_size = NB_SIZE_EMPIRICAL;
+			break;
+		case OPT_VALUE_SIZE: {
+			int i = 0;
+			while (i < NB_SIZE_MAX &&
+			       strcmp(nb_size_type_names[i], optarg) != 0)
+				i++;
+			if (i == NB_SIZE_MAX) {
+				fprintf(stderr, "Invalid value size: %s\n",
+					optarg);
+				usage();
+				return -1;
+			}
+			opts.value_size = (enum nb_size_type) i;
+			break;
+		}
+		case OPT_VLEN_MIN:
+			opts.val_len_min = atol(optarg);
+			break;
+		case OPT_VALUE_SIZES:
+			opts.value_sizes = optarg;
+			opts.value_size = NB_SIZE_EMPIRICAL;
+			break;
+		case OPT_COMPRESSION_RATIO:
+			opts.compression_ratio = atof(optarg);
+			break;
+		case OPT_VERIFY:
+			opts.verify = true;
+			break;
+		case OPT_SELECT_INTO:
+			opts.select_into = true;
+			break;
+		case OPT_TIMER: {
+			int i = 0;
+			while (i < NB_TIMER_MAX &&
+			       strcmp(nb_timer_type_names[i], optarg) != 0)
+				i++;
+			if (i == NB_TIMER_MAX) {
+				fprintf(stderr, "Invalid timer: %s\n",
+					optarg);
+				usage();
+				return -1;
+			}
+			opts.timer = (enum nb_timer_type) i;
+			break;
+		}
+		case OPT_TIMER_SUBTRACT:
+			opts.timer_subtract = true;
+			break;
+		case OPT_PERF_COUNTERS:
+			opts.perf_counters = true;
+			break;
+		case OPT_IO_STATS:
+			opts.io_stats = true;
+			break;
+		case OPT_MEMORY_STATS:
+			opts.memory_stats = true;
+			break;
+		case OPT_CPUS:
+			opts.cpus = optarg;
+			break;
+		case OPT_NUMA_POLICY:
+			if (strcmp(optarg, "local") == 0) {
+				opts.numa_policy = NB_NUMA_LOCAL;
+			} else if (strcmp(optarg, "interleave") == 0) {
+				opts.numa_policy = NB_NUMA_INTERLEAVE;
+			} else if (strncmp(optarg, "node:", 5) == 0 &&
+				   optarg[5] != '\0') {
+				opts.numa_policy = NB_NUMA_NODE;
+				opts.numa_node = atoi(optarg + 5);
+			} else {
+				fprintf(stderr, "Invalid NUMA policy: %s\n",
+					optarg);
+				usage();
+				return -1;
+			}
+			break;
+		case OPT_SHARDS:
+			opts.shards = atol(optarg);
+			break;
+		case OPT_SHARD_THREADS:
+			opts.shard_threads = true;
+			break;
+		case OPT_READ_ORDER:
+			if (strcmp(optarg, "insert") == 0) {
+				opts.read_permuted = false;
+			} else if (strcmp(optarg, "permuted") == 0) {
+				opts.read_permuted = true;
+			} else {
+				fprintf(stderr, "Invalid read order: %s\n",
+					optarg);
+				usage();
+				return -1;
+			}
+			break;
+		case OPT_ZIPF_THETA:
+			opts.zipf_theta = atof(optarg);
+			break;
+		case OPT_HOT_KEYS:
+			opts.hot_keys = atof(optarg);
+			break;
+		case OPT_HOT_OPS:
+			opts.hot_ops = atof(optarg);
+			break;
 		default:
 			fprintf(stderr, "Invalid option: %x\n", c);
 			usage();
@@ -192,18 +722,150 @@ main(int argc, char *argv[])
 		return -1;
 	}
 
+	opts.merge_files = argv + optind;
+	opts.merge_files_count = argc - optind;
+	if (action->action == action_merge)
+		return action->action(&opts);
+
+	if (nb_time_init(opts.timer) != 0)
+		return -1;
+
+	if (opts.key_len_min == 0)
+		opts.key_len_min = opts.key_len;
+
 	fprintf(stderr, "Mini NoSQL Benchmark\n");
 	fprintf(stderr, "====================\n");
 	fprintf(stderr, "\n");
 
 	fprintf(stderr, "Path: %s\n",   opts.path);
-	fprintf(stderr, "Keys File: %s\n", opts.keys_filename);
+	if (opts.key_format == NB_KEY_FILE) {
+		fprintf(stderr, "Keys File: %s\n", opts.keys_filename);
+	} else {
+		fprintf(stderr, "Keys: generated, %s\n",
+			nb_key_format_names[opts.key_format]);
+	}
 
 	fprintf(stderr, "Action: %s\n", action->name);
 	fprintf(stderr, "Driver: %s\n", opts.driver);
-	fprintf(stderr, "Key Len: %zu\n", opts.key_len);
-	fprintf(stderr, "Val Len: %zu\n", opts.val_len);
+	switch (opts.key_size) {
+	case NB_SIZE_FIXED:
+		fprintf(stderr, "Key Len: %zu\n", opts.key_len);
+		break;
+	case NB_SIZE_EMPIRICAL:
+		fprintf(stderr, "Key Len: empirical, %s\n", opts.key_sizes);
+		break;
+	default:
+		fprintf(stderr, "Key Len: %s, %zu-%zu\n",
+			nb_size_type_names[opts.key_size],
+			opts.key_len_min, opts.key_len);
+		break;
+	}
+	switch (opts.value_size) {
+	case NB_SIZE_FIXED:
+		fprintf(stderr, "Val Len: %zu\n", opts.val_len);
+		break;
+	case NB_SIZE_EMPIRICAL:
+		fprintf(stderr, "Val Len: empirical, %s\n", opts.value_sizes);
+		break;
+	default:
+		fprintf(stderr, "Val Len: %s, %zu-%zu\n",
+			nb_size_type_names[opts.value_size],
+			opts.val_len_min, opts.val_len);
+		break;
+	}
+	fprintf(stderr, "Compression Ratio: %.2lf\n", opts.compression_ratio);
 	fprintf(stderr, "Count: %zu\n", opts.count);
+	fprintf(stderr, "Threads: %zu\n", opts.threads);
+	if (opts.rate > 0) {
+		fprintf(stderr, "Rate: %zu ops/sec\n", opts.rate);
+	}
+	if (action->action == action_mixed) {
+		fprintf(stderr, "Read Ratio: %.4lf\n", opts.read_ratio);
+		fprintf(stderr, "Update Ratio: %.4lf\n", opts.update_ratio);
+		fprintf(stderr, "Scan Ratio: %.4lf\n", opts.scan_ratio);
+	}
+	if (opts.batch > 1) {
+		fprintf(stderr, "Batch: %zu\n", opts.batch);
+	}
+	if (action->action == action_churn) {
+		fprintf(stderr, "Churn Ops: %zu\n", opts.churn_ops > 0 ?
+			opts.churn_ops : opts.count);
+	}
+	if (opts.queue_depth > 0) {
+		fprintf(stderr, "Queue Depth: %zu\n", opts.queue_depth);
+	}
+	if (opts.shards > 1) {
+		fprintf(stderr, "Shards: %zu%s\n", opts.shards,
+			opts.shard_threads ? ", a thread per shard" : "");
+	}
+	if (opts.duration > 0) {
+		fprintf(stderr, "Duration: %.1lf sec\n", opts.duration);
+	}
+	if (opts.warmup > 0) {
+		fprintf(stderr, "Warm-up: %.1lf sec\n", opts.warmup);
+	}
+	if (opts.warmup_ops > 0) {
+		fprintf(stderr, "Warm-up Ops: %zu\n", opts.warmup_ops);
+	}
+	if (opts.samples != NULL) {
+		fprintf(stderr, "Samples: %s every %.1lf sec\n", opts.samples,
+			opts.sample_interval);
+	}
+	if (action->action == action_scan || opts.scan_ratio > 0) {
+		fprintf(stderr, "Scan Length: %zu\n", opts.scan_length);
+	}
+	if (opts.verify) {
+		fprintf(stderr, "Verify: yes\n");
+	}
+	if (opts.select_into) {
+		fprintf(stderr, "Select Into: yes\n");
+	}
+	if (opts.perf_counters) {
+		fprintf(stderr, "Perf Counters: yes\n");
+	}
+	if (opts.io_stats) {
+		fprintf(stderr, "I/O Stats: yes\n");
+	}
+	if (opts.memory_stats) {
+		fprintf(stderr, "Memory Stats: yes\n");
+	}
+	if (opts.cpus != NULL) {
+		fprintf(stderr, "CPUs: %s\n", opts.cpus);
+	}
+	if (opts.numa_policy == NB_NUMA_NODE) {
+		fprintf(stderr, "NUMA Policy: node %d\n", opts.numa_node);
+	} else if (opts.numa_policy != NB_NUMA_DEFAULT) {
+		fprintf(stderr, "NUMA Policy: %s\n",
+			nb_numa_policy_names[opts.numa_policy]);
+	}
+	if (opts.cpus != NULL || opts.numa_policy != NB_NUMA_DEFAULT) {
+		nb_numa_print(stderr);
+	}
+	if (opts.read_permuted) {
+		fprintf(stderr, "Read Order: permuted\n");
+	}
+	if (opts.distribution != NB_RANDOM_SEQUENTIAL) {
+		fprintf(stderr, "Distribution: %s\n",
+			nb_random_type_names[opts.distribution]);
+	}
+	if (opts.distribution == NB_RANDOM_ZIPFIAN ||
+	    opts.distribution == NB_RANDOM_LATEST) {
+		fprintf(stderr, "Zipf Theta: %.4lf\n", opts.zipf_theta);
+	}
+	if (opts.distribution == NB_RANDOM_HOTSPOT) {
+		fprintf(stderr, "Hotspot: %.2lf%% of ops on %.2lf%% of keys\n",
+			opts.hot_ops * 1e2, opts.hot_keys * 1e2);
+	}
+	fprintf(stderr, "Seed: %llu\n", (unsigned long long) opts.seed);
+	if (nb_time_source() == NB_TIMER_TSC) {
+		fprintf(stderr, "Timer: tsc, %.3lf GHz",
+			nb_time_tsc_hz() * 1e-9);
+	} else {
+		fprintf(stderr, "Timer: clock_gettime");
+	}
+	fprintf(stderr, ", overhead %llu ns%s\n",
+		(unsigned long long) nb_time_overhead(),
+		opts.timer_subtract ? " (subtracted)" : "");
 
 	return action->action(&opts);
 }
@@ -0,0 +1,247 @@
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE /* CPU_SET(), syscall() */
+
+#include "nb_cpu.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+const char *nb_numa_policy_names[NB_NUMA_MAX] = {
+	[NB_NUMA_DEFAULT] = "default",
+	[NB_NUMA_LOCAL] = "local",
+	[NB_NUMA_INTERLEAVE] = "interleave",
+	[NB_NUMA_NODE] = "node",
+};
+
+/* Node masks of set_mempolicy() */
+enum { NB_NODES_MAX = 1024 };
+enum { NB_ULONG_BITS = 8 * sizeof(unsigned long) };
+
+int
+nb_cpus_parse(struct nb_cpus *cpus, const char *list)
+{
+	cpus->count = 0;
+
+	const char *p = list;
+	while (*p != '\0') {
+		char *end;
+		long first = strtol(p, &end, 10);
+		long last = first;
+		if (end == p)
+			goto error;
+		if (*end == '-') {
+			p = end + 1;
+			last = strtol(p, &end, 10);
+			if (end == p)
+				goto error;
+		}
+		if (first < 0 || last < first || last >= NB_CPUS_MAX)
+			goto error;
+		for (long id = first; id <= last; id++) {
+			if (cpus->count == NB_CPUS_MAX)
+				goto error;
+			cpus->ids[cpus->count++] = (int) id;
+		}
+		if (*end == ',')
+			end++;
+		else if (*end != '\0')
+			goto error;
+		p = end;
+	}
+
+	if (cpus->count == 0)
+		goto error;
+	return 0;
+
+error:
+	fprintf(stderr, "Invalid list: %s\n", list);
+	return -1;
+}
+
+/* Read a list of a sysfs file, e.g. online nodes or CPUs of a node */
+static int
+nb_cpus_read(struct nb_cpus *cpus, const char *filename)
+{
+	FILE *file = fopen(filename, "r");
+	if (file == NULL)
+		return -1;
+
+	char buf[4096];
+	size_t len = fread(buf, 1, sizeof(buf) - 1, file);
+	fclose(file);
+	buf[len] = '\0';
+	buf[strcspn(buf, "\n")] = '\0';
+
+	return nb_cpus_parse(cpus, buf);
+}
+
+/* A missing CPU would fail only later, when a worker is created */
+static int
+nb_cpus_check_online(const struct nb_cpus *cpus)
+{
+	struct nb_cpus online;
+	if (nb_cpus_read(&online, "/sys/devices/system/cpu/online") != 0) {
+		fprintf(stderr, "Failed to read online CPUs\n");
+		return -1;
+	}
+
+	for (size_t i = 0; i < cpus->count; i++) {
+		size_t k = 0;
+		while (k < online.count && online.ids[k] != cpus->ids[i])
+			k++;
+		if (k == online.count) {
+			fprintf(stderr, "CPU %d is not online\n",
+				cpus->ids[i]);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int
+nb_cpus_pin(const struct nb_cpus *cpus)
+{
+	if (nb_cpus_check_online(cpus) != 0)
+		return -1;
+
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (size_t i = 0; i < cpus->count; i++)
+		CPU_SET(cpus->ids[i], &set);
+
+	if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+		perror("sched_setaffinity");
+		return -1;
+	}
+
+	return 0;
+}
+
+int
+nb_cpu_attr(pthread_attr_t *attr, int cpu)
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+
+	int rc = pthread_attr_setaffinity_np(attr, sizeof(set), &set);
+	if (rc != 0) {
+		fprintf(stderr, "pthread_attr_setaffinity_np: %s\n",
+			strerror(rc));
+		return -1;
+	}
+
+	return 0;
+}
+
+int
+nb_numa_set_policy(enum nb_numa_policy policy, int node)
+{
+	unsigned long mask[NB_NODES_MAX / NB_ULONG_BITS];
+	memset(mask, 0, sizeof(mask));
+
+	int mode = MPOL_DEFAULT;
+	switch (policy) {
+	case NB_NUMA_DEFAULT:
+		return 0;
+	case NB_NUMA_LOCAL:
+		mode = MPOL_LOCAL;
+		break;
+	case NB_NUMA_INTERLEAVE: {
+		struct nb_cpus nodes;
+		if (nb_cpus_read(&nodes,
+				 "/sys/devices/system/node/online") != 0) {
+			fprintf(stderr, "Failed to read online NUMA nodes\n");
+			return -1;
+		}
+		for (size_t i = 0; i < nodes.count; i++) {
+			mask[nodes.ids[i] / NB_ULONG_BITS] |=
+				1UL << (nodes.ids[i] % NB_ULONG_BITS);
+		}
+		mode = MPOL_INTERLEAVE;
+		break;
+	}
+	case NB_NUMA_NODE:
+		if (node < 0 || node >= NB_NODES_MAX) {
+			fprintf(stderr, "Invalid NUMA node: %d\n", node);
+			return -1;
+		}
+		mask[node / NB_ULONG_BITS] |= 1UL << (node % NB_ULONG_BITS);
+		mode = MPOL_BIND;
+		break;
+	default:
+		return -1;
+	}
+
+	/* The kernel takes the number of bits plus one */
+	unsigned long maxnode = mode == MPOL_LOCAL ? 0 : NB_NODES_MAX + 1;
+	if (syscall(SYS_set_mempolicy, mode,
+		    mode == MPOL_LOCAL ? NULL : mask, maxnode) != 0) {
+		perror("set_mempolicy");
+		return -1;
+	}
+
+	return 0;
+}
+
+void
+nb_numa_print(FILE *file)
+{
+	struct nb_cpus nodes;
+	if (nb_cpus_read(&nodes, "/sys/devices/system/node/online") != 0) {
+		fprintf(file, "NUMA Nodes: unknown\n");
+		return;
+	}
+
+	fprintf(file, "NUMA Nodes: %zu\n", nodes.count);
+	for (size_t i = 0; i < nodes.count; i++) {
+		char filename[128];
+		snprintf(filename, sizeof(filename),
+			 "/sys/devices/system/node/node%d/cpulist",
+			 nodes.ids[i]);
+		char cpus[4096] = "";
+		FILE *f = fopen(filename, "r");
+		if (f != NULL) {
+			if (fgets(cpus, sizeof(cpus), f) == NULL)
+				cpus[0] = '\0';
+			fclose(f);
+		}
+		cpus[strcspn(cpus, "\n")] = '\0';
+		fprintf(file, "Node %d CPUs: %s\n", nodes.ids[i], cpus);
+	}
+}
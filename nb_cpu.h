@@ -0,0 +1,83 @@
+#ifndef NB_CPU_H_INCLUDED
+#define NB_CPU_H_INCLUDED
+
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <pthread.h>
+
+/* Placement of memory allocated by the process (--numa-policy) */
+enum nb_numa_policy {
+	/* the policy of the system */
+	NB_NUMA_DEFAULT,
+	/* the node of the CPU which allocates memory */
+	NB_NUMA_LOCAL,
+	/* pages are spread over all nodes */
+	NB_NUMA_INTERLEAVE,
+	/* pages are allocated on one node only */
+	NB_NUMA_NODE,
+	NB_NUMA_MAX
+};
+
+extern const char *nb_numa_policy_names[NB_NUMA_MAX];
+
+enum { NB_CPUS_MAX = 1024 };
+
+/* A list of CPUs or nodes in the order it was given */
+struct nb_cpus {
+	size_t count;
+	int ids[NB_CPUS_MAX];
+};
+
+/* Parse a list like "0-3,8,10-11" */
+int
+nb_cpus_parse(struct nb_cpus *cpus, const char *list);
+
+/* Allow the calling thread to run on the CPUs only, all must be online */
+int
+nb_cpus_pin(const struct nb_cpus *cpus);
+
+/* Threads created with the attributes run on the CPU only */
+int
+nb_cpu_attr(pthread_attr_t *attr, int cpu);
+
+/*
+ * Set the memory policy of the calling thread. Threads created by it
+ * later inherit the policy.
+ */
+int
+nb_numa_set_policy(enum nb_numa_policy policy, int node);
+
+/* Print online NUMA nodes and their CPUs */
+void
+nb_numa_print(FILE *file);
+
+#endif /* NB_CPU_H_INCLUDED */
@@ -31,151 +31,1545 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <string.h>
 #include <assert.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
 
-#include "nb_plugin.h"
+#include "nb_engine_int.h"
 #include "nb_histogram.h"
-#include "nb_random.h"
+#include "nb_monitor.h"
+#include "nb_report.h"
 #include "nb_time.h"
 
-int
-nb_engine_run(struct nb_opts *opts, enum nb_bench_type bench_type)
+/* Variable-length keys of a keys file are at least that long */
+enum { NB_KEY_PREFIX_MIN = 8 };
+
+/* Histograms of a run above this size are reported on start */
+enum { NB_HISTOGRAM_WARN_SIZE = 64 * 1024 * 1024 };
+
+static int
+nb_engine_init_ops(struct nb_engine *engine)
+{
+	struct nb_opts *opts = engine->opts;
+	double ratio[NB_OP_MAX] = { 0.0 };
+
+	switch (engine->bench_type) {
+	case NB_BENCH_GET:
+		ratio[NB_OP_GET] = 1.0;
+		break;
+	case NB_BENCH_PUT:
+		ratio[NB_OP_PUT] = 1.0;
+		break;
+	case NB_BENCH_SCAN:
+		ratio[NB_OP_SCAN] = 1.0;
+		break;
+	case NB_BENCH_MIXED:
+		ratio[NB_OP_GET] = opts->read_ratio;
+		ratio[NB_OP_PUT] = opts->update_ratio;
+		ratio[NB_OP_SCAN] = opts->scan_ratio;
+		break;
+	case NB_BENCH_DELETE:
+		ratio[NB_OP_DELETE] = 1.0;
+		break;
+	case NB_BENCH_CHURN:
+		/* Deletes and inserts strictly alternate, see next_op() */
+		if (opts->batch > 1) {
+			fprintf(stderr, "--batch can't be used with churn\n");
+			return -1;
+		}
+		ratio[NB_OP_DELETE] = 0.5;
+		ratio[NB_OP_PUT] = 0.5;
+		break;
+	default:
+		assert(0);
+	}
+
+	/* With --batch all writes are grouped into batches */
+	if (opts->batch > 1) {
+		ratio[NB_OP_BATCH] = ratio[NB_OP_PUT];
+		ratio[NB_OP_PUT] = 0.0;
+	}
+
+	double sum = 0.0;
+	for (int op = 0; op < NB_OP_MAX; op++) {
+		if (ratio[op] < 0.0) {
+			fprintf(stderr, "Invalid %s ratio: %lf\n",
+				nb_op_names[op], ratio[op]);
+			return -1;
+		}
+		sum += ratio[op];
+	}
+
+	if (sum <= 0.0) {
+		fprintf(stderr, "At least one ratio must be positive\n");
+		return -1;
+	}
+
+	/* Ratios are normalized, so both 0.95/0.05 and 95/5 work */
+	double cdf = 0.0;
+	for (int op = 0; op < NB_OP_MAX; op++) {
+		cdf += ratio[op] / sum;
+		engine->op_cdf[op] = cdf;
+	}
+	engine->op_cdf[NB_OP_MAX - 1] = 1.0;
+
+	engine->op_fixed = -1;
+	for (int op = 0; op < NB_OP_MAX; op++) {
+		if (ratio[op] == sum)
+			engine->op_fixed = op;
+		engine->op_used[op] = ratio[op] > 0.0;
+	}
+
+	return 0;
+}
+
+static bool
+nb_engine_uses_op(struct nb_engine *engine, enum nb_op op)
+{
+	double prev = (op > 0) ? engine->op_cdf[op - 1] : 0.0;
+	return engine->op_cdf[op] > prev;
+}
+
+/* Keys may be used again only by workloads that don't delete them */
+static bool
+nb_engine_keys_reusable(struct nb_engine *engine)
+{
+	return engine->bench_type != NB_BENCH_DELETE &&
+	       engine->bench_type != NB_BENCH_CHURN;
+}
+
+/* The shard of a key depends on the key only, not on --seed */
+static size_t
+nb_engine_shard(const struct nb_engine *engine, const void *key,
+		size_t key_len)
 {
+	if (engine->shards == 1)
+		return 0;
+	return nb_random_hash(key, key_len, 0) % engine->shards;
+}
+
+static void
+nb_engine_shard_path(const struct nb_engine *engine, size_t shard,
+		     char *path, size_t size)
+{
+	snprintf(path, size, "%s/shard-%zu", engine->opts->db_opts.path,
+		 shard);
+}
+
+static int
+nb_engine_open_keys(struct nb_engine *engine, struct nb_random *random)
+{
+	struct nb_opts *opts = engine->opts;
+
+	if (opts->key_format != NB_KEY_FILE)
+		return nb_random_create_generated(random, opts->key_format,
+						  opts->seed);
+
+	if (nb_random_create(random, opts->keys_filename) != 0) {
+		fprintf(stderr, "random_create failed\n");
+		fprintf(stderr, "Please generate random file using dd:\n"
+			"dd if=/dev/urandom of=keys.bin bs=1M count=100\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Number of keys of the worker's slice which belong to its shard */
+static size_t
+nb_worker_count_keys(struct nb_worker *w)
+{
+	size_t key_size = w->engine->key_size;
+	size_t key_len;
+	size_t keys = 0;
+
+	while (nb_random_next(&w->random, w->keybuf, key_size,
+			      &key_len) == 0) {
+		if (nb_engine_shard(w->engine, w->keybuf, key_len) == w->shard)
+			keys++;
+	}
+	nb_random_slice(&w->random, w->keys_offset, w->keys_size);
+
+	return keys;
+}
+
+static int
+nb_worker_create(struct nb_worker *w, struct nb_engine *engine, size_t id)
+{
+	struct nb_opts *opts = engine->opts;
 	int rc = 0;
 
-	char path[PATH_MAX];
-	snprintf(path, PATH_MAX - 1, "%s/%s", opts->path, opts->driver);
-	path[PATH_MAX - 1] = 0;
-	opts->db_opts.path = path;
+	memset(w, 0, sizeof(*w));
+	w->engine = engine;
+	w->id = id;
+	for (int e = 0; e < NB_PERF_MAX; e++)
+		w->perf.fd[e] = -1;
+	w->rng = opts->seed + id;
 
-	rc++;
-	struct nb_plugin *plugin = nb_plugin_load(opts->driver);
-	if (plugin == NULL) {
-		fprintf(stderr, "Driver '%s' is not found!\n", opts->driver);
-		goto error_1;
+	/*
+	 * With --shard-threads worker i serves shard i % shards and splits
+	 * keys with other workers of the shard only. Every worker skips keys
+	 * of other shards in its slice.
+	 */
+	size_t part = id;
+	size_t parts = engine->workers_count;
+	w->shard = SIZE_MAX;
+	if (opts->shard_threads) {
+		w->shard = id % engine->shards;
+		part = id / engine->shards;
+		parts = (engine->workers_count - w->shard +
+			 engine->shards - 1) / engine->shards;
 	}
 
-	rc++;
-	struct nb_db *db = plugin->pif->open(&opts->db_opts);
-	if (db == NULL) {
-		fprintf(stderr, "driver::new failed\n");
-		goto error_2;
+	/* Split keys between threads: every worker gets its own slice */
+	size_t first = opts->count * part / parts;
+	size_t last = opts->count * (part + 1) / parts;
+	w->count = last - first;
+
+	/*
+	 * Churn: the first --count keys of the file are the live set loaded
+	 * by a previous PUT run, the following --churn-ops keys are inserted.
+	 * Every worker deletes its slice of the live set in order and then
+	 * the keys it has inserted itself, so the live set size is constant.
+	 */
+	size_t live_first = first;
+	size_t live_count = w->count;
+	if (engine->bench_type == NB_BENCH_CHURN) {
+		size_t churn = opts->churn_ops;
+		size_t new_first = churn * part / parts;
+		size_t new_last = churn * (part + 1) / parts;
+		w->new_offset = (opts->count + new_first) * engine->key_size;
+		w->new_size = (new_last - new_first) * engine->key_size;
+		first = opts->count + new_first;
+		w->count = new_last - new_first;
 	}
 
-	char *keybuf = malloc(opts->key_len);
-	if (keybuf == NULL) {
+	/* A batch needs a separate buffer for every key */
+	size_t batch = opts->batch > 1 ? opts->batch : 1;
+	/* So does every request in flight */
+	size_t depth = opts->queue_depth;
+	size_t keys = batch > depth ? batch : depth;
+
+	rc--;
+	w->keybuf = malloc(engine->key_size * keys);
+	if (w->keybuf == NULL) {
 		fprintf(stderr, "key malloc failed\n");
+		goto error_1;
+	}
+
+	if (opts->select_into) {
+		w->valbuf_size = engine->values.sizes.max;
+		w->valbuf = malloc(w->valbuf_size);
+		if (w->valbuf == NULL) {
+			fprintf(stderr, "value malloc failed\n");
+			goto error_3;
+		}
+	}
+
+	rc--;
+	if (nb_engine_open_keys(engine, &w->random) != 0)
 		goto error_3;
+
+	rc--;
+	w->keys_offset = first * engine->key_size;
+	w->keys_size = w->count * engine->key_size;
+	if (nb_random_slice(&w->random, w->keys_offset, w->keys_size) != 0) {
+		fprintf(stderr, "keys file is too small for %zu records\n",
+			first + w->count);
+		goto error_4;
 	}
 
-	char *valbuf = malloc(opts->val_len);
-	if (valbuf == NULL) {
-		fprintf(stderr, "val malloc failed\n");
+	if (engine->key_sizes.type != NB_SIZE_FIXED)
+		nb_random_set_key_sizes(&w->random, &engine->key_sizes,
+					opts->seed);
+
+	/* One permutation of the loaded set is shared by all workers */
+	if (opts->read_permuted &&
+	    nb_random_set_permutation(&w->random, opts->count, engine->key_size,
+				      opts->seed) != 0) {
+		fprintf(stderr, "keys file is too small for %zu records\n",
+			opts->count);
 		goto error_4;
 	}
 
-	struct nb_random random;
-	if (nb_random_create(&random, opts->keys_filename) != 0) {
-		fprintf(stderr, "random_create failed\n");
-		fprintf(stderr, "Please generate random file using dd:\n"
-			"dd if=/dev/urandom of=keys.bin bs=1M count=100\n");
+	/* Keys of other shards are skipped, see nb_worker_next_key() */
+	if (w->shard != SIZE_MAX) {
+		size_t keys = nb_worker_count_keys(w);
+		if (engine->dist.type == NB_RANDOM_SEQUENTIAL || keys == 0)
+			w->count = keys;
+		else
+			w->count = opts->count * (id + 1) /
+				   engine->workers_count -
+				   opts->count * id / engine->workers_count;
+	}
+
+	/* Key streams of workers don't overlap with their op streams */
+	if (engine->dist.type != NB_RANDOM_SEQUENTIAL &&
+	    nb_random_set_dist(&w->random, &engine->dist, engine->key_size,
+			       opts->seed + engine->workers_count + id) != 0) {
+		fprintf(stderr, "keys file is too small for %zu records\n",
+			opts->count);
+		goto error_4;
+	}
+
+	if (engine->bench_type == NB_BENCH_CHURN) {
+		rc--;
+		if (nb_engine_open_keys(engine, &w->oldest) != 0)
+			goto error_4;
+		if (engine->key_sizes.type != NB_SIZE_FIXED)
+			nb_random_set_key_sizes(&w->oldest, &engine->key_sizes,
+						opts->seed);
+
+		rc--;
+		if (nb_random_slice(&w->oldest, live_first * engine->key_size,
+				    live_count * engine->key_size) != 0) {
+			fprintf(stderr, "keys file is too small for %zu "
+				"records\n", opts->count);
+			goto error_5;
+		}
+		/* a pair of ops per key */
+		w->count *= 2;
+	}
+
+	rc--;
+	w->batch = calloc(batch, sizeof(*w->batch));
+	if (w->batch == NULL) {
+		fprintf(stderr, "batch malloc failed\n");
 		goto error_5;
 	}
 
-	struct nb_histogram *hist = nb_histogram_new(6);
-	if (hist == NULL) {
-		fprintf(stderr, "nb_histogram_new() failed\n");
+	for (size_t i = 0; i < batch; i++) {
+		w->batch[i].key = w->keybuf + engine->key_size * i;
+	}
+
+	/* Records of a batch go to their shards in smaller batches */
+	if (engine->shards > 1 && w->shard == SIZE_MAX && batch > 1) {
+		rc--;
+		w->batch_shards = calloc(batch, sizeof(*w->batch_shards));
+		w->shard_batch = calloc(batch, sizeof(*w->shard_batch));
+		if (w->batch_shards == NULL || w->shard_batch == NULL) {
+			fprintf(stderr, "batch malloc failed\n");
+			goto error_6;
+		}
+	}
+
+	rc--;
+	if (nb_stats_create(&w->stats, engine->op_used, opts->rate > 0,
+			    opts->hist_digits, engine->shards) != 0)
+		goto error_6;
+
+	/* Without a warm-up its stats stay zeroed */
+	w->warmup_ops = opts->warmup_ops * (id + 1) / engine->workers_count -
+			opts->warmup_ops * id / engine->workers_count;
+	bool warmup = opts->warmup > 0 || w->warmup_ops > 0;
+	w->cur = warmup ? &w->warmup : &w->stats;
+
+	rc--;
+	if (warmup &&
+	    nb_stats_create(&w->warmup, engine->op_used, opts->rate > 0,
+			    opts->hist_digits, engine->shards) != 0) {
+		nb_stats_destroy(&w->stats);
 		goto error_6;
 	}
 
-	size_t prev_count = 0;
-	size_t total_count = 0;
+	if (opts->samples != NULL) {
+		rc--;
+		w->interval[0] = nb_histogram_new(6, opts->hist_digits);
+		w->interval[1] = nb_histogram_new(6, opts->hist_digits);
+		if (w->interval[0] == NULL || w->interval[1] == NULL) {
+			fprintf(stderr, "nb_histogram_new() failed\n");
+			goto error_7;
+		}
+	}
 
-	fprintf(stderr, "Benchmarking...");
-	for (size_t kk = 0; kk < opts->count; kk++) {
-		const void *key;
-		size_t key_len;
-		const void *val;
-		size_t val_len;
-
-		if (nb_random_next(&random, keybuf, opts->key_len) != 0) {
-			fprintf(stderr, "random_next failed\n");
+	/* Time-bounded runs reuse keys as long as it is harmless */
+	if (opts->duration > 0 && nb_engine_keys_reusable(engine) &&
+	    w->count > 0)
+		w->count = SIZE_MAX;
+
+	if (depth > 0) {
+		rc--;
+		w->reqs = calloc(depth, sizeof(*w->reqs));
+		w->idle = calloc(depth, sizeof(*w->idle));
+		w->completed = calloc(depth, sizeof(*w->completed));
+		if (w->reqs == NULL || w->idle == NULL ||
+		    w->completed == NULL) {
+			fprintf(stderr, "queue malloc failed\n");
+			goto error_7;
+		}
+
+		for (size_t i = 0; i < depth; i++) {
+			struct nb_db_req *req = &w->reqs[i].req;
+			req->key = w->keybuf + engine->key_size * i;
+			w->idle[i] = &w->reqs[i];
+		}
+		w->idle_count = depth;
+
+		rc--;
+		size_t shard = w->shard != SIZE_MAX ? w->shard : 0;
+		w->queue = nb_queue_new(engine->plugin->pif,
+					engine->dbs[shard], depth);
+		if (w->queue == NULL)
+			goto error_8;
+	}
+
+	atomic_init(&w->done, 0);
+	atomic_init(&w->sampling, false);
+
+	return 0;
+
+error_8:
+	free(w->completed);
+	free(w->idle);
+	free(w->reqs);
+error_7:
+	for (int i = 0; i < 2; i++) {
+		if (w->interval[i] != NULL)
+			nb_histogram_delete(w->interval[i]);
+	}
+	nb_stats_destroy(&w->warmup);
+	nb_stats_destroy(&w->stats);
+error_6:
+	free(w->shard_batch);
+	free(w->batch_shards);
+	free(w->batch);
+error_5:
+	if (engine->bench_type == NB_BENCH_CHURN)
+		nb_random_destroy(&w->oldest);
+error_4:
+	nb_random_destroy(&w->random);
+error_3:
+	free(w->valbuf);
+	free(w->keybuf);
+error_1:
+	return rc;
+}
+
+static void
+nb_worker_destroy(struct nb_worker *w)
+{
+	if (w->queue != NULL)
+		nb_queue_delete(w->queue);
+	free(w->completed);
+	free(w->idle);
+	free(w->reqs);
+	for (int i = 0; i < 2; i++) {
+		if (w->interval[i] != NULL)
+			nb_histogram_delete(w->interval[i]);
+	}
+	nb_stats_destroy(&w->warmup);
+	nb_stats_destroy(&w->stats);
+	free(w->shard_batch);
+	free(w->batch_shards);
+	free(w->batch);
+	if (w->engine->bench_type == NB_BENCH_CHURN)
+		nb_random_destroy(&w->oldest);
+	nb_random_destroy(&w->random);
+	free(w->valbuf);
+	free(w->keybuf);
+	nb_perf_close(&w->perf);
+}
+
+/*
+ * Wait until the intended start time of the next op.
+ * Sleeps are too coarse for high rates, so the tail is spent spinning.
+ */
+static void
+nb_worker_wait(double until)
+{
+	const double spin = 250e-6;
+
+	double now = nb_clock();
+	if (until - now > 2 * spin) {
+		double delay = until - now - spin;
+		struct timespec ts;
+		ts.tv_sec = (time_t) delay;
+		ts.tv_nsec = (long) ((delay - ts.tv_sec) * 1e9);
+		nanosleep(&ts, NULL);
+	}
+
+	while (nb_clock() < until)
+		;
+}
+
+static enum nb_op
+nb_worker_next_op(struct nb_worker *w, size_t ops)
+{
+	const double *op_cdf = w->engine->op_cdf;
+
+	/* Churn deletes the oldest key and then inserts a new one */
+	if (w->engine->bench_type == NB_BENCH_CHURN)
+		return (ops % 2 == 0) ? NB_OP_DELETE : NB_OP_PUT;
+
+	/* Pure workloads don't need to consume random numbers */
+	if (w->engine->op_fixed >= 0)
+		return (enum nb_op) w->engine->op_fixed;
+
+	double u = nb_random_double(&w->rng);
+	int op = 0;
+	while (op < NB_OP_MAX - 1 && u >= op_cdf[op])
+		op++;
+
+	return (enum nb_op) op;
+}
+
+static int
+nb_worker_read_key(struct nb_worker *w, enum nb_op op, char *key,
+		   size_t *key_len)
+{
+	size_t key_size = w->engine->key_size;
+
+	if (w->engine->bench_type != NB_BENCH_CHURN || op != NB_OP_DELETE) {
+		if (nb_random_next(&w->random, key, key_size, key_len) == 0)
+			return 0;
+		/* The run is time-bounded, start over */
+		if (w->count != SIZE_MAX ||
+		    nb_random_slice(&w->random, w->keys_offset,
+				    w->keys_size) != 0)
+			return -1;
+		return nb_random_next(&w->random, key, key_size, key_len);
+	}
+
+	if (nb_random_next(&w->oldest, key, key_size, key_len) == 0)
+		return 0;
+
+	/* The initial live set is gone, continue with inserted keys */
+	if (w->oldest_wrapped ||
+	    nb_random_slice(&w->oldest, w->new_offset, w->new_size) != 0)
+		return -1;
+	w->oldest_wrapped = true;
+
+	return nb_random_next(&w->oldest, key, key_size, key_len);
+}
+
+static int
+nb_worker_next_key(struct nb_worker *w, enum nb_op op, char *key,
+		   size_t *key_len)
+{
+	int rc;
+	do {
+		rc = nb_worker_read_key(w, op, key, key_len);
+	} while (rc == 0 && w->shard != SIZE_MAX &&
+		 nb_engine_shard(w->engine, key, *key_len) != w->shard);
+
+	return rc;
+}
+
+/* The shard which stores the key */
+static inline size_t
+nb_worker_shard(struct nb_worker *w, const void *key, size_t key_len)
+{
+	if (w->shard != SIZE_MAX)
+		return w->shard;
+	return nb_engine_shard(w->engine, key, key_len);
+}
+
+/* Count a request to the shard */
+static inline void
+nb_worker_shard_op(struct nb_worker *w, size_t shard, double time)
+{
+	if (w->cur->shard_ops == NULL)
+		return;
+	w->cur->shard_ops[shard]++;
+	w->cur->shard_time[shard] += time;
+}
+
+/*
+ * Switch to the measured phase once the warm-up is over. Returns false
+ * when the run is over.
+ */
+static bool
+nb_worker_tick(struct nb_worker *w, size_t done, double now)
+{
+	struct nb_opts *opts = w->engine->opts;
+
+	if (w->cur == &w->warmup) {
+		if (now - w->begin < opts->warmup || done < w->warmup_ops)
+			return true;
+		w->cur = &w->stats;
+		w->start = now;
+		w->warmup_done = done;
+		if (opts->perf_counters)
+			nb_perf_read(&w->perf, &w->perf_start);
+	}
+
+	return opts->duration <= 0 || now - w->start < opts->duration;
+}
+
+/* Latency in nanoseconds between two nb_clock() readings */
+static inline uint64_t
+nb_latency(double t0, double t1)
+{
+	return t1 > t0 ? (uint64_t) ((t1 - t0) * 1e9) : 0;
+}
+
+/* Latency of an op less the cost of reading the clock */
+static inline uint64_t
+nb_worker_latency(struct nb_worker *w, double t0, double t1)
+{
+	uint64_t latency = nb_latency(t0, t1);
+	uint64_t overhead = w->engine->timer_overhead;
+	return latency > overhead ? latency - overhead : 0;
+}
+
+/*
+ * Add a latency to the histogram of the current sample interval.
+ * The flag pairs with the epoch flip in nb_monitor_sample(): once the
+ * monitor sees it cleared, no add to the previous histogram is pending.
+ */
+static void
+nb_worker_sample(struct nb_worker *w, uint64_t latency)
+{
+	if (w->interval[0] == NULL)
+		return;
+
+	atomic_store(&w->sampling, true);
+	unsigned epoch = atomic_load(&w->engine->epoch);
+	nb_histogram_add(w->interval[epoch & 1], latency);
+	atomic_store_explicit(&w->sampling, false, memory_order_release);
+}
+
+/* Record end times of segments completed by `done` ops */
+static void
+nb_worker_segments(struct nb_worker *w, size_t done)
+{
+	while (w->segments_done < NB_SEGMENTS &&
+	       done >= w->count * (w->segments_done + 1) / NB_SEGMENTS) {
+		w->segments[w->segments_done++] = nb_clock();
+	}
+}
+
+/* Sharded: the scan reads the shard of the first key only */
+static int
+nb_worker_scan(struct nb_worker *w, struct nb_db *db, const void *key,
+	       size_t key_len)
+{
+	const struct nb_db_if *pif = w->engine->plugin->pif;
+
+	struct nb_db_cursor *cursor = pif->cursor_seek(db, key, key_len);
+	if (cursor == NULL) {
+		fprintf(stderr, "Seek failed :(\n");
+		return 1;
+	}
+
+	size_t n = 0;
+	for (; n < w->engine->opts->scan_length; n++) {
+		const void *rkey, *rval;
+		size_t rkey_len, rval_len;
+		int r = pif->cursor_next(cursor, &rkey, &rkey_len,
+					 &rval, &rval_len);
+		if (r > 0)
+			break;
+		if (r < 0) {
+			fprintf(stderr, "Next failed :(\n");
+			pif->cursor_close(cursor);
 			return 1;
 		}
+	}
 
-		key = keybuf;
-		key_len = opts->key_len;
-		val = valbuf;
-		val_len = opts->val_len;
+	pif->cursor_close(cursor);
+	w->cur->records[NB_OP_SCAN] += n;
 
-		double t0 = nb_clock();
-		switch (bench_type) {
-		case NB_BENCH_GET:
-			if (plugin->pif->select(db, key, key_len,
-						NULL, NULL) != 0) {
-				fprintf(stdout, "key: %.*s\n",
-					(int) key_len, (char *) key);
-				fprintf(stderr, "Select failed :(\n");
+	return 0;
+}
+
+static int
+nb_worker_write_records(struct nb_worker *w, struct nb_db *db,
+			const struct nb_db_record *records, size_t count)
+{
+	const struct nb_db_if *pif = w->engine->plugin->pif;
+
+	if (pif->write_batch != NULL) {
+		if (pif->write_batch(db, records, count) != 0) {
+			fprintf(stderr, "Write batch failed :(\n");
+			return 1;
+		}
+	} else {
+		/* The driver has no native batches */
+		for (size_t i = 0; i < count; i++) {
+			const struct nb_db_record *rec = &records[i];
+			if (pif->replace(db, rec->key, rec->key_len,
+					 rec->val, rec->val_len) != 0) {
+				fprintf(stderr, "Replace failed :(\n");
 				return 1;
 			}
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Records of a sharded batch are written to every shard as a batch of
+ * its own. Requests to shards are counted here, not by the caller.
+ */
+static int
+nb_worker_write_batch(struct nb_worker *w, size_t shard, size_t count)
+{
+	struct nb_engine *engine = w->engine;
+
+	if (w->shard_batch == NULL) {
+		if (nb_worker_write_records(w, engine->dbs[shard], w->batch,
+					    count) != 0)
+			return 1;
+		w->cur->records[NB_OP_BATCH] += count;
+		return 0;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		w->batch_shards[i] = nb_engine_shard(engine, w->batch[i].key,
+						     w->batch[i].key_len);
+	}
+
+	for (size_t s = 0; s < engine->shards; s++) {
+		size_t n = 0;
+		for (size_t i = 0; i < count; i++) {
+			if (w->batch_shards[i] == s)
+				w->shard_batch[n++] = w->batch[i];
+		}
+		if (n == 0)
+			continue;
+
+		double t0 = nb_clock();
+		if (nb_worker_write_records(w, engine->dbs[s], w->shard_batch,
+					    n) != 0)
+			return 1;
+		nb_worker_shard_op(w, s, nb_clock() - t0);
+	}
+
+	w->cur->records[NB_OP_BATCH] += count;
+
+	return 0;
+}
+
+/* Check the value of the last GET and give it back to the driver */
+static void
+nb_worker_verify(struct nb_worker *w, struct nb_db *db, const void *key,
+		 size_t key_len)
+{
+	const struct nb_db_if *pif = w->engine->plugin->pif;
+
+	if (w->val == NULL) {
+		w->cur->missing++;
+		return;
+	}
+
+	size_t len;
+	const char *expected = nb_value_get(&w->engine->values, key, key_len,
+					    &len);
+	if (w->val_len == len && memcmp(w->val, expected, len) == 0)
+		w->cur->verified++;
+	else
+		w->cur->corrupted++;
+
+	if (w->val != w->valbuf) {
+		if (pif->valfree != NULL)
+			pif->valfree(db, w->val);
+		else
+			free(w->val);
+	}
+	w->val = NULL;
+}
+
+/* GET the value, into w->val if it is checked by --verify */
+static int
+nb_worker_select(struct nb_worker *w, struct nb_db *db, const void *key,
+		 size_t key_len)
+{
+	const struct nb_opts *opts = w->engine->opts;
+	const struct nb_db_if *pif = w->engine->plugin->pif;
+
+	w->val = NULL;
+	if (opts->select_into) {
+		/* A truncated value is still found, --verify rejects it */
+		if (pif->select_into(db, key, key_len, w->valbuf,
+				     w->valbuf_size, &w->val_len) < 0)
+			return -1;
+		w->val = w->valbuf;
+		return 0;
+	}
+
+	if (!opts->verify)
+		return pif->select(db, key, key_len, NULL, NULL);
+
+	if (pif->select(db, key, key_len, &w->val, &w->val_len) != 0) {
+		w->val = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+static int
+nb_worker_exec(struct nb_worker *w, enum nb_op op, size_t shard,
+	       const void *key, size_t key_len, size_t count)
+{
+	const struct nb_db_if *pif = w->engine->plugin->pif;
+	struct nb_db *db = w->engine->dbs[shard];
+
+	switch (op) {
+	case NB_OP_GET:
+		if (nb_worker_select(w, db, key, key_len) != 0) {
+			/* A failed lookup is counted as a missing record */
+			if (w->engine->opts->verify)
+				break;
+			fprintf(stdout, "key: %.*s\n",
+				(int) key_len, (char *) key);
+			fprintf(stderr, "Select failed :(\n");
+			return 1;
+		}
+		break;
+	case NB_OP_PUT:
+		if (pif->replace(db, key, key_len, w->batch[0].val,
+				 w->batch[0].val_len) != 0) {
+			fprintf(stderr, "Replace failed :(\n");
+			return 1;
+		}
+		break;
+	case NB_OP_DELETE:
+		if (pif->remove(db, key, key_len) != 0) {
+			fprintf(stderr, "Remove failed :(\n");
+			return 1;
+		}
+		break;
+	case NB_OP_BATCH:
+		return nb_worker_write_batch(w, shard, count);
+	case NB_OP_SCAN:
+		return nb_worker_scan(w, db, key, key_len);
+	default:
+		assert(0);
+	}
+
+	return 0;
+}
+
+static int
+nb_worker_loop(struct nb_worker *w)
+{
+	struct nb_engine *engine = w->engine;
+	size_t key_len = engine->key_size;
+
+	/*
+	 * Open-loop mode: ops are issued on a fixed schedule regardless of
+	 * how long previous ops took. Threads are staggered within a period
+	 * to avoid issuing ops in bursts.
+	 */
+	double period = 0.0;
+	double phase = 0.0;
+	if (engine->opts->rate > 0) {
+		period = (double) engine->workers_count / engine->opts->rate;
+		phase = period * w->id / engine->workers_count;
+	}
+
+	/* kk counts keys, a batch consumes several keys in one op */
+	size_t kk = 0;
+	for (size_t ops = 0; kk < w->count; ops++) {
+		if (atomic_load_explicit(&engine->stop, memory_order_relaxed))
 			break;
-		case NB_BENCH_PUT:
-			if (plugin->pif->replace(db, key, key_len,
-						 val, val_len) != 0) {
-				fprintf(stderr, "Replace failed :(\n");
-				goto error_5;
+
+		enum nb_op op = nb_worker_next_op(w, ops);
+
+		size_t count = 1;
+		if (op == NB_OP_BATCH) {
+			count = engine->opts->batch;
+			if (count > w->count - kk)
+				count = w->count - kk;
+		}
+
+		size_t bytes = 0;
+		for (size_t i = 0; i < count; i++) {
+			if (nb_worker_next_key(w, op, w->keybuf + key_len * i,
+					       &w->batch[i].key_len) != 0) {
+				fprintf(stderr, "random_next failed\n");
+				return 1;
+			}
+			if (op == NB_OP_PUT || op == NB_OP_BATCH) {
+				w->batch[i].val = nb_value_get(&engine->values,
+						w->keybuf + key_len * i,
+						w->batch[i].key_len,
+						&w->batch[i].val_len);
+				bytes += w->batch[i].key_len +
+					 w->batch[i].val_len;
 			}
+		}
+
+		double intended = 0.0;
+		if (period > 0.0) {
+			intended = w->begin + phase + period * ops;
+			nb_worker_wait(intended);
+		}
+
+		size_t shard = nb_worker_shard(w, w->keybuf,
+					       w->batch[0].key_len);
+		double t0 = nb_clock();
+		int rc = nb_worker_exec(w, op, shard, w->keybuf,
+					w->batch[0].key_len, count);
+		double t1 = nb_clock();
+		if (rc != 0)
+			return rc;
+		if (op == NB_OP_GET && engine->opts->verify)
+			nb_worker_verify(w, engine->dbs[shard], w->keybuf,
+					 w->batch[0].key_len);
+		if (op != NB_OP_BATCH || w->shard_batch == NULL)
+			nb_worker_shard_op(w, shard, t1 - t0);
+
+		uint64_t latency = nb_worker_latency(w, t0, t1);
+		nb_histogram_add(w->cur->hist[op], latency);
+		w->cur->time[op] += t1 - t0;
+		w->cur->bytes[op] += bytes;
+		nb_worker_sample(w, latency);
+		if (period > 0.0) {
+			nb_histogram_add(w->cur->hist_corrected[op],
+					 nb_worker_latency(w, intended, t1));
+		}
+
+		kk += count;
+		atomic_store_explicit(&w->done, kk, memory_order_relaxed);
+		nb_worker_segments(w, kk);
+		if (!nb_worker_tick(w, kk, t1))
 			break;
-		default:
-			assert(0);
+	}
+
+	return 0;
+}
+
+/*
+ * Pipelined mode: up to --queue-depth requests are kept in flight.
+ * Latency is measured from submission to completion.
+ */
+static int
+nb_worker_loop_async(struct nb_worker *w)
+{
+	struct nb_engine *engine = w->engine;
+	size_t depth = engine->opts->queue_depth;
+	int rc = 0;
+
+	size_t submitted = 0;
+	size_t kk = 0;
+	bool running = true;
+	while (true) {
+		/* Stop submitting on errors, but drain requests in flight */
+		while (rc == 0 && running && w->idle_count > 0 &&
+		       submitted < w->count &&
+		       !atomic_load_explicit(&engine->stop,
+					     memory_order_relaxed)) {
+			struct nb_worker_req *wr = w->idle[w->idle_count - 1];
+			struct nb_db_req *req = &wr->req;
+
+			wr->op = nb_worker_next_op(w, submitted);
+			if (nb_worker_next_key(w, wr->op, (char *) req->key,
+					       &req->key_len) != 0) {
+				fprintf(stderr, "random_next failed\n");
+				rc = 1;
+				break;
+			}
+
+			req->val = NULL;
+			req->val_len = 0;
+			switch (wr->op) {
+			case NB_OP_GET:
+				req->type = NB_DB_REQ_SELECT;
+				break;
+			case NB_OP_PUT:
+				req->type = NB_DB_REQ_REPLACE;
+				req->val = nb_value_get(&engine->values,
+							req->key, req->key_len,
+							&req->val_len);
+				break;
+			case NB_OP_DELETE:
+				req->type = NB_DB_REQ_REMOVE;
+				break;
+			default:
+				assert(0);
+			}
+			req->rc = 0;
+
+			wr->start = nb_clock();
+			if (nb_queue_submit(w->queue, req) != 0) {
+				fprintf(stderr, "Submit failed :(\n");
+				rc = 1;
+				break;
+			}
+			w->idle_count--;
+			submitted++;
 		}
 
+		if (w->idle_count == depth)
+			break;
+
+		size_t n = nb_queue_poll(w->queue, w->completed, depth);
 		double t1 = nb_clock();
-		double td = t1 - t0;
-		nb_histogram_add(hist, td);
+		for (size_t i = 0; i < n; i++) {
+			struct nb_worker_req *wr =
+				(struct nb_worker_req *) w->completed[i];
+			w->idle[w->idle_count++] = wr;
 
-		prev_count++;
-		total_count++;
+			if (wr->req.rc != 0) {
+				static const char *names[] = {
+					[NB_DB_REQ_SELECT] = "Select",
+					[NB_DB_REQ_REPLACE] = "Replace",
+					[NB_DB_REQ_REMOVE] = "Remove",
+				};
+				fprintf(stderr, "%s failed :(\n",
+					names[wr->req.type]);
+				rc = 1;
+				continue;
+			}
 
-		if (prev_count < opts->report_interval)
-			continue;
+			uint64_t latency = nb_worker_latency(w, wr->start, t1);
+			nb_histogram_add(w->cur->hist[wr->op], latency);
+			w->cur->time[wr->op] += t1 - wr->start;
+			if (wr->op == NB_OP_PUT) {
+				w->cur->bytes[wr->op] += wr->req.key_len +
+							 wr->req.val_len;
+			}
+			nb_worker_sample(w, latency);
+			nb_worker_shard_op(w, w->shard, t1 - wr->start);
+			kk++;
+		}
+		atomic_store_explicit(&w->done, kk, memory_order_relaxed);
+		nb_worker_segments(w, kk);
+		running = nb_worker_tick(w, kk, t1);
+	}
 
-		fprintf(stderr, "\r%zu ops done...", total_count);
-		prev_count = 0;
+	return rc;
+}
+
+static void *
+nb_worker_run(void *arg)
+{
+	struct nb_worker *w = (struct nb_worker *) arg;
+	struct nb_engine *engine = w->engine;
+	bool perf = engine->opts->perf_counters;
+
+	/* Counters belong to the thread, so they are opened here */
+	if (perf)
+		nb_perf_open(&w->perf);
+
+	/* Wait until all threads are ready to start */
+	pthread_mutex_lock(&engine->gate_lock);
+	while (!engine->gate_open)
+		pthread_cond_wait(&engine->gate_cond, &engine->gate_lock);
+	pthread_mutex_unlock(&engine->gate_lock);
+
+	if (perf)
+		nb_perf_enable(&w->perf);
+	w->begin = nb_clock();
+	w->start = w->begin;
+	if (engine->opts->queue_depth > 0)
+		w->rc = nb_worker_loop_async(w);
+	else
+		w->rc = nb_worker_loop(w);
+	w->stop = nb_clock();
+	if (perf)
+		nb_perf_read(&w->perf, &w->perf_stop);
+
+	/* The run was over before the end of the warm-up */
+	if (w->cur == &w->warmup) {
+		w->start = w->stop;
+		w->warmup_done = atomic_load(&w->done);
+		w->perf_start = w->perf_stop;
+	}
+
+	if (w->rc != 0) {
+		atomic_store(&engine->stop, true);
+	}
+	atomic_fetch_sub(&engine->running, 1);
+
+	return NULL;
+}
+
+/* RSS of the keys file mapped by workers, pages are faulted on use */
+static uint64_t
+nb_engine_keys_rss(struct nb_engine *engine)
+{
+	uint64_t rss = 0;
+	if (engine->opts->key_format == NB_KEY_FILE &&
+	    nb_mem_read_mapped(engine->opts->keys_filename, &rss) != 0)
+		return 0;
+	return rss;
+}
+
+/*
+ * Open the database, or `shards` databases in subdirectories of its path.
+ * Drivers keep a pointer to their options, so every shard has options of
+ * its own which live as long as the database. Drivers create the last
+ * component of the path only.
+ */
+static int
+nb_engine_open_dbs(struct nb_engine *engine)
+{
+	struct nb_db_opts *db_opts = &engine->opts->db_opts;
+	const struct nb_db_if *pif = engine->plugin->pif;
+	int rc = 0;
+
+	rc--;
+	engine->dbs = calloc(engine->shards, sizeof(*engine->dbs));
+	if (engine->dbs == NULL) {
+		fprintf(stderr, "shards malloc failed\n");
+		goto error_1;
+	}
+
+	if (engine->shards == 1) {
+		rc--;
+		engine->dbs[0] = pif->open(db_opts);
+		if (engine->dbs[0] == NULL) {
+			fprintf(stderr, "driver::new failed\n");
+			goto error_2;
+		}
+		return 0;
+	}
+
+	rc--;
+	engine->shard_opts = calloc(engine->shards,
+				    sizeof(*engine->shard_opts));
+	if (engine->shard_opts == NULL) {
+		fprintf(stderr, "shards malloc failed\n");
+		goto error_2;
 	}
 
-	fprintf(stderr, "\r%zu ops done...\n", opts->count);
+	rc--;
+	if (mkdir(db_opts->path, 0777) != 0 && errno != EEXIST) {
+		perror("mkdir");
+		goto error_3;
+	}
 
-	double percentiles[] = { 0.05, 0.50, 0.95, 0.96, 0.97, 0.98, 0.99,
-				 0.995, 0.999, 0.9995, 0.9999 };
-	size_t percentiles_size = sizeof(percentiles) / sizeof(percentiles[0]);
+	rc--;
+	size_t opened = 0;
+	for (; opened < engine->shards; opened++) {
+		struct nb_shard *shard = &engine->shard_opts[opened];
+		shard->opts = *db_opts;
+		nb_engine_shard_path(engine, opened, shard->path,
+				     sizeof(shard->path));
+		shard->opts.path = shard->path;
+		engine->dbs[opened] = pif->open(&shard->opts);
+		if (engine->dbs[opened] == NULL) {
+			fprintf(stderr, "driver::new failed\n");
+			goto error_4;
+		}
+	}
 
-	fprintf(stdout, "Histogram:\n");
-	nb_histogram_dump(hist, stdout, percentiles, percentiles_size);
+	return 0;
 
-	plugin->pif->close(db);
+error_4:
+	for (size_t s = 0; s < opened; s++)
+		pif->close(engine->dbs[s]);
+error_3:
+	free(engine->shard_opts);
+error_2:
+	free(engine->dbs);
+error_1:
+	return rc;
+}
 
-	nb_histogram_delete(hist);
-	nb_random_destroy(&random);
+static void
+nb_engine_close_dbs(struct nb_engine *engine)
+{
+	for (size_t s = 0; s < engine->shards; s++)
+		engine->plugin->pif->close(engine->dbs[s]);
+	free(engine->shard_opts);
+	free(engine->dbs);
+}
 
-	free(valbuf);
-	free(keybuf);
+/* Find out which events can be counted by opening them for this thread */
+static int
+nb_engine_check_perf(struct nb_engine *engine)
+{
+	struct nb_perf perf;
+	if (nb_perf_open(&perf) == 0) {
+		fprintf(stderr, "perf_event_open() failed, check "
+			"/proc/sys/kernel/perf_event_paranoid\n");
+		return -1;
+	}
 
-	nb_plugin_unload(plugin);
+	for (int e = 0; e < NB_PERF_MAX; e++) {
+		engine->perf_supported[e] = nb_perf_has(&perf, e);
+		if (!engine->perf_supported[e]) {
+			fprintf(stderr, "Event '%s' is not supported\n",
+				nb_perf_event_names[e]);
+		}
+	}
 
+	nb_perf_close(&perf);
 	return 0;
+}
+
+int
+nb_engine_run(struct nb_opts *opts, enum nb_bench_type bench_type)
+{
+	int rc = 0;
+
+	struct nb_engine engine;
+	memset(&engine, 0, sizeof(engine));
+	engine.opts = opts;
+	engine.bench_type = bench_type;
+	engine.timer_overhead = opts->timer_subtract ? nb_time_overhead() : 0;
+	engine.workers_count = opts->threads > 0 ? opts->threads : 1;
+	engine.shards = opts->shards > 0 ? opts->shards : 1;
+	if (bench_type == NB_BENCH_CHURN && opts->churn_ops == 0)
+		opts->churn_ops = opts->count;
 
+	rc++;
+	if (nb_engine_init_ops(&engine) != 0)
+		goto error_1;
+
+	engine.dist.type = opts->distribution;
+	engine.dist.theta = opts->zipf_theta;
+	engine.dist.hot_keys = opts->hot_keys;
+	engine.dist.hot_ops = opts->hot_ops;
+	if (opts->read_permuted &&
+	    (bench_type == NB_BENCH_CHURN ||
+	     engine.dist.type != NB_RANDOM_SEQUENTIAL)) {
+		fprintf(stderr, "--read-order=permuted can't be used with "
+			"churn or --distribution\n");
+		goto error_1;
+	}
+
+	if (engine.dist.type != NB_RANDOM_SEQUENTIAL) {
+		if (!nb_engine_keys_reusable(&engine)) {
+			fprintf(stderr, "Only sequential keys can be used "
+				"with delete and churn\n");
+			goto error_1;
+		}
+		if (nb_random_dist_init(&engine.dist, opts->count) != 0)
+			goto error_1;
+	}
+
+	char path[PATH_MAX];
+	snprintf(path, PATH_MAX - 1, "%s/%s", opts->path, opts->driver);
+	path[PATH_MAX - 1] = 0;
+	opts->db_opts.path = path;
+	opts->db_opts.batch = opts->batch > 1 ? opts->batch : 1;
+
+	rc++;
+	if (opts->queue_depth > 0 &&
+	    (nb_engine_uses_op(&engine, NB_OP_BATCH) ||
+	     nb_engine_uses_op(&engine, NB_OP_SCAN))) {
+		fprintf(stderr, "Only GET, PUT and DELETE operations can be "
+			"used with --queue-depth\n");
+		goto error_1;
+	}
+
+	if (opts->queue_depth > 0 && (opts->verify || opts->select_into)) {
+		fprintf(stderr, "--verify and --select-into can't be used "
+			"with --queue-depth\n");
+		goto error_1;
+	}
+
+	if (opts->queue_depth > 0 && opts->rate > 0) {
+		fprintf(stderr, "--queue-depth can't be used with --rate\n");
+		goto error_1;
+	}
+
+	/* A queue serves a single database */
+	if (opts->queue_depth > 0 && engine.shards > 1 &&
+	    !opts->shard_threads) {
+		fprintf(stderr, "--queue-depth can be used with --shards only "
+			"with --shard-threads\n");
+		goto error_1;
+	}
+
+	if (opts->shard_threads && engine.workers_count < engine.shards) {
+		fprintf(stderr, "--shard-threads needs at least a thread per "
+			"shard\n");
+		goto error_1;
+	}
+
+	if (opts->perf_counters && nb_engine_check_perf(&engine) != 0)
+		goto error_1;
+
+	if (opts->io_stats && nb_io_read(&engine.io_begin, path) != 0)
+		goto error_1;
+
+	/*
+	 * Threads inherit the affinity and the memory policy of this thread,
+	 * and so do buffers allocated from here on: the value pool, keys and
+	 * caches of the database.
+	 */
+	if (opts->cpus != NULL &&
+	    (nb_cpus_parse(&engine.cpus, opts->cpus) != 0 ||
+	     nb_cpus_pin(&engine.cpus) != 0))
+		goto error_1;
+
+	if (nb_numa_set_policy(opts->numa_policy, opts->numa_node) != 0)
+		goto error_1;
+
+	rc++;
+	engine.key_sizes.type = opts->key_size;
+	engine.key_sizes.min = opts->key_len_min;
+	engine.key_sizes.max = opts->key_len;
+	engine.key_sizes.theta = opts->zipf_theta;
+	engine.key_sizes.filename = opts->key_sizes;
+	engine.key_sizes.name = "key";
+	if (nb_random_sizes_create(&engine.key_sizes) != 0)
+		goto error_1;
+	/* Records of the keys file fit the longest key */
+	engine.key_size = engine.key_sizes.max;
+
+	/* Keys are prefixes of records, short prefixes of a file repeat */
+	if (opts->key_format == NB_KEY_FILE &&
+	    engine.key_sizes.type != NB_SIZE_FIXED &&
+	    engine.key_sizes.min < NB_KEY_PREFIX_MIN) {
+		fprintf(stderr, "Keys of a file must be at least %d bytes "
+			"long to be unique, the minimal length is %zu\n",
+			NB_KEY_PREFIX_MIN, engine.key_sizes.min);
+		goto error_2;
+	}
+
+	rc++;
+	engine.values.sizes.type = opts->value_size;
+	engine.values.sizes.min = opts->val_len_min;
+	engine.values.sizes.max = opts->val_len;
+	engine.values.sizes.theta = opts->zipf_theta;
+	engine.values.compression = opts->compression_ratio;
+	engine.values.sizes.filename = opts->value_sizes;
+	engine.values.sizes.name = "value";
+	if (nb_value_pool_create(&engine.values, opts->seed) != 0)
+		goto error_2;
+
+	if (opts->key_format != NB_KEY_FILE) {
+		uint64_t keys = nb_random_generated_max(opts->key_format,
+							engine.key_sizes.min);
+		uint64_t needed = (uint64_t) opts->count + opts->churn_ops;
+		if (keys < needed) {
+			fprintf(stderr, "%zu-byte %s keys are not enough for "
+				"%llu records\n", engine.key_sizes.min,
+				nb_key_format_names[opts->key_format],
+				(unsigned long long) needed);
+			goto error_3;
+		}
+	}
+
+	/* The footprint of the database is the growth from here */
+	if (opts->memory_stats && nb_mem_read(&engine.mem_begin) != 0)
+		goto error_3;
+
+	rc++;
+	engine.plugin = nb_plugin_load(opts->driver);
+	if (engine.plugin == NULL) {
+		fprintf(stderr, "Driver '%s' is not found!\n", opts->driver);
+		goto error_3;
+	}
+
+	/* A database is used by its own threads only with --shard-threads */
+	opts->db_opts.threads = engine.workers_count;
+	if (opts->shard_threads) {
+		opts->db_opts.threads = (engine.workers_count +
+					 engine.shards - 1) / engine.shards;
+	}
+	/* The fallback pool calls the driver from `depth` threads per worker */
+	if (opts->queue_depth > 0 && !nb_queue_is_native(engine.plugin->pif)) {
+		opts->db_opts.threads *= opts->queue_depth;
+		fprintf(stderr, "Driver '%s' doesn't support asynchronous "
+			"requests, using a thread pool instead\n", opts->driver);
+	}
+
+	rc++;
+	if (nb_engine_uses_op(&engine, NB_OP_SCAN) &&
+	    engine.plugin->pif->cursor_seek == NULL) {
+		fprintf(stderr, "Driver '%s' doesn't support range scans\n",
+			opts->driver);
+		goto error_4;
+	}
+
+	/* Counters of a worker don't see the work of its pool threads */
+	if (opts->perf_counters && opts->queue_depth > 0 &&
+	    !nb_queue_is_native(engine.plugin->pif)) {
+		fprintf(stderr, "--perf-counters can't be used with "
+			"--queue-depth for drivers without asynchronous "
+			"requests\n");
+		goto error_4;
+	}
+
+	if (opts->select_into && engine.plugin->pif->select_into == NULL) {
+		fprintf(stderr, "Driver '%s' doesn't support select into "
+			"a buffer\n", opts->driver);
+		goto error_4;
+	}
+
+	if (nb_engine_uses_op(&engine, NB_OP_BATCH) &&
+	    engine.plugin->pif->write_batch == NULL) {
+		fprintf(stderr, "Driver '%s' doesn't support write batches, "
+			"using replace() instead\n", opts->driver);
+	}
+
+	rc++;
+	if (nb_engine_open_dbs(&engine) != 0)
+		goto error_4;
+
+	/* Workers and stats allocated from here on are the harness */
+	struct nb_mem mem_opened;
+	if (opts->memory_stats && nb_mem_read(&mem_opened) != 0)
+		mem_opened = engine.mem_begin;
+
+	rc++;
+	void *workers = NULL;
+	if (posix_memalign(&workers, NB_CACHELINE_SIZE,
+			   engine.workers_count * sizeof(struct nb_worker)) != 0) {
+		fprintf(stderr, "workers malloc failed\n");
+		goto error_5;
+	}
+	engine.workers = (struct nb_worker *) workers;
+
+	size_t created = 0;
+	for (; created < engine.workers_count; created++) {
+		if (nb_worker_create(&engine.workers[created], &engine,
+				     created) != 0)
+			goto error_6;
+	}
+
+	rc++;
+	struct nb_stats stats;
+	if (nb_stats_create(&stats, engine.op_used, opts->rate > 0,
+			    opts->hist_digits, engine.shards) != 0)
+		goto error_6;
+
+	if (opts->memory_stats) {
+		struct nb_mem mem;
+		uint64_t keys_rss = nb_engine_keys_rss(&engine);
+		if (nb_mem_read(&mem) == 0 &&
+		    mem.rss > mem_opened.rss + keys_rss)
+			engine.mem_harness = mem.rss - mem_opened.rss -
+					     keys_rss;
+	}
+
+	size_t hist_size = nb_stats_footprint(&stats);
+	for (size_t i = 0; i < engine.workers_count; i++) {
+		struct nb_worker *w = &engine.workers[i];
+		hist_size += nb_stats_footprint(&w->stats) +
+			     nb_stats_footprint(&w->warmup);
+		for (int k = 0; k < 2; k++) {
+			struct nb_histogram *hist = w->interval[k];
+			if (hist != NULL)
+				hist_size += nb_histogram_footprint(hist);
+		}
+	}
+	if (hist_size > NB_HISTOGRAM_WARN_SIZE) {
+		fprintf(stderr, "Latency histograms take %.1lf MB, a lower "
+			"--histogram-digits takes less\n",
+			hist_size / (1024.0 * 1024.0));
+	}
+
+	rc++;
+	if (opts->samples != NULL && nb_monitor_open_samples(&engine) != 0)
+		goto error_7;
+
+	atomic_init(&engine.stop, false);
+	atomic_init(&engine.running, engine.workers_count);
+	pthread_mutex_init(&engine.gate_lock, NULL);
+	pthread_cond_init(&engine.gate_cond, NULL);
+	engine.gate_open = false;
+
+	fprintf(stderr, "Benchmarking...");
+	int worker_rc = 0;
+	size_t started = 0;
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	for (; started < engine.workers_count; started++) {
+		struct nb_worker *w = &engine.workers[started];
+		size_t cpus = engine.cpus.count;
+		int cpu = cpus > 0 ? engine.cpus.ids[started % cpus] : -1;
+		if ((cpu >= 0 && nb_cpu_attr(&attr, cpu) != 0) ||
+		    pthread_create(&w->thread, &attr, nb_worker_run, w) != 0) {
+			fprintf(stderr, "pthread_create failed\n");
+			atomic_store(&engine.stop, true);
+			atomic_fetch_sub(&engine.running,
+					 engine.workers_count - started);
+			worker_rc = 1;
+			break;
+		}
+	}
+	pthread_attr_destroy(&attr);
+
+	/* I/O of opening the database is not a part of the run */
+	if (opts->io_stats) {
+		nb_io_read(&engine.io_begin, path);
+		engine.io_sample = engine.io_begin;
+	}
+	if (opts->memory_stats)
+		nb_mem_read(&engine.mem_sample);
+
+	pthread_mutex_lock(&engine.gate_lock);
+	engine.gate_open = true;
+	pthread_cond_broadcast(&engine.gate_cond);
+	pthread_mutex_unlock(&engine.gate_lock);
+
+	nb_monitor_run(&engine);
+
+	for (size_t i = 0; i < started; i++) {
+		struct nb_worker *w = &engine.workers[i];
+		pthread_join(w->thread, NULL);
+		nb_stats_merge(&stats, &w->stats);
+		if (w->rc != 0)
+			worker_rc = w->rc;
+	}
+	pthread_cond_destroy(&engine.gate_cond);
+	pthread_mutex_destroy(&engine.gate_lock);
+
+	if (opts->io_stats && nb_io_read(&engine.io_end, path) != 0)
+		engine.io_end = engine.io_sample;
+	if (opts->memory_stats) {
+		if (nb_mem_read(&engine.mem_end) != 0)
+			engine.mem_end = engine.mem_sample;
+		nb_mem_read_pss(&engine.mem_end);
+		engine.mem_harness += nb_engine_keys_rss(&engine);
+	}
+
+	size_t measured = 0;
+	for (int op = 0; op < NB_OP_MAX; op++) {
+		measured += nb_stats_count(&stats, op);
+	}
+	if (worker_rc == 0 && measured == 0) {
+		fprintf(stderr, "No ops were measured, is the warm-up "
+			"longer than the run?\n");
+		worker_rc = 1;
+	}
+
+	if (worker_rc == 0 && nb_report(&engine, &stats) != 0) {
+		worker_rc = 1;
+	}
+
+	if (worker_rc == 0 && stats.corrupted + stats.missing > 0) {
+		fprintf(stderr, "Verification failed: %zu corrupted, %zu "
+			"missing records\n", stats.corrupted, stats.missing);
+		worker_rc = 1;
+	}
+
+	if (engine.samples != NULL)
+		nb_monitor_close_samples(&engine);
+	nb_stats_destroy(&stats);
+	for (size_t i = 0; i < engine.workers_count; i++) {
+		nb_worker_destroy(&engine.workers[i]);
+	}
+	free(engine.workers);
+
+	nb_engine_close_dbs(&engine);
+	nb_plugin_unload(engine.plugin);
+	nb_value_pool_destroy(&engine.values);
+	nb_random_sizes_destroy(&engine.key_sizes);
+
+	return worker_rc;
+
+error_7:
+	nb_stats_destroy(&stats);
 error_6:
-	nb_random_destroy(&random);
+	for (size_t i = 0; i < created; i++) {
+		nb_worker_destroy(&engine.workers[i]);
+	}
+	free(engine.workers);
 error_5:
-	free(valbuf);
+	nb_engine_close_dbs(&engine);
 error_4:
-	free(keybuf);
-
+	nb_plugin_unload(engine.plugin);
 error_3:
-	plugin->pif->close(db);
+	nb_value_pool_destroy(&engine.values);
 error_2:
-	nb_plugin_unload(plugin);
+	nb_random_sizes_destroy(&engine.key_sizes);
 error_1:
 	return rc;
 }
@@ -36,7 +36,11 @@
 
 enum nb_bench_type {
 	NB_BENCH_GET,
-	NB_BENCH_PUT
+	NB_BENCH_PUT,
+	NB_BENCH_SCAN,
+	NB_BENCH_MIXED,
+	NB_BENCH_DELETE,
+	NB_BENCH_CHURN
 };
 
 int
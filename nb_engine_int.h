@@ -0,0 +1,201 @@
+#ifndef NB_ENGINE_INT_H_INCLUDED
+#define NB_ENGINE_INT_H_INCLUDED
+
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * The state of a running benchmark, shared by the engine, the monitor and
+ * the report. Not an interface for anything else.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "nb_engine.h"
+#include "nb_plugin.h"
+#include "nb_cpu.h"
+#include "nb_io.h"
+#include "nb_mem.h"
+#include "nb_perf.h"
+#include "nb_queue.h"
+#include "nb_random.h"
+#include "nb_stats.h"
+#include "nb_value.h"
+
+enum { NB_CACHELINE_SIZE = 64 };
+
+/* Number of equal parts of a run used to report throughput decay */
+enum { NB_SEGMENTS = 10 };
+
+/* An asynchronous request in flight (--queue-depth) */
+struct nb_worker_req {
+	struct nb_db_req req;
+	enum nb_op op;
+	double start;
+};
+
+struct nb_worker {
+	/* updated by the worker on every op, read by the monitor */
+	atomic_size_t done;
+	/* set while the worker adds to an interval histogram */
+	atomic_bool sampling;
+	char pad[NB_CACHELINE_SIZE - sizeof(atomic_size_t) -
+		 sizeof(atomic_bool)];
+
+	struct nb_engine *engine;
+	pthread_t thread;
+	size_t id;
+	size_t count;
+	struct nb_random random;
+	/* the slice of the keys file used by the worker */
+	size_t keys_offset;
+	size_t keys_size;
+	/* churn: keys to delete, the oldest live keys first */
+	struct nb_random oldest;
+	bool oldest_wrapped;
+	/* churn: keys inserted by this worker */
+	size_t new_offset;
+	size_t new_size;
+	/* the shard of all keys of the worker or SIZE_MAX (--shard-threads) */
+	size_t shard;
+	/* state of PRNG used to choose an operation in mixed workloads */
+	uint64_t rng;
+	char *keybuf;
+	/* the buffer for values (--select-into) */
+	char *valbuf;
+	size_t valbuf_size;
+	/* the value returned by the last GET (--verify) */
+	void *val;
+	size_t val_len;
+	/* records of a write batch (--batch) */
+	struct nb_db_record *batch;
+	/* shards of records of the batch and records of one shard */
+	size_t *batch_shards;
+	struct nb_db_record *shard_batch;
+	/* pipelined mode: the queue, its requests and idle requests */
+	struct nb_queue *queue;
+	struct nb_worker_req *reqs;
+	struct nb_worker_req **idle;
+	size_t idle_count;
+	struct nb_db_req **completed;
+	/* stats of the current phase: &warmup or &stats */
+	struct nb_stats *cur;
+	struct nb_stats warmup;
+	struct nb_stats stats;
+	/* latencies of the current and the previous sample interval */
+	struct nb_histogram *interval[2];
+	/* number of ops of the warm-up phase for this worker */
+	size_t warmup_ops;
+	size_t warmup_done;
+	/* the time when the run began, including the warm-up */
+	double begin;
+	/* the time when the measured phase began */
+	double start;
+	/* hardware counters of the worker thread (--perf-counters) */
+	struct nb_perf perf;
+	struct nb_perf_counts perf_start;
+	struct nb_perf_counts perf_stop;
+	/* counts at the end of the previous sample interval */
+	struct nb_perf_counts perf_sample;
+	double stop;
+	/* end times of completed segments of the run */
+	double segments[NB_SEGMENTS];
+	size_t segments_done;
+	int rc;
+};
+
+/* Options of a shard, drivers keep a pointer to them */
+struct nb_shard {
+	struct nb_db_opts opts;
+	char path[PATH_MAX];
+};
+
+struct nb_engine {
+	struct nb_opts *opts;
+	enum nb_bench_type bench_type;
+	/* cumulative probabilities of operations */
+	double op_cdf[NB_OP_MAX];
+	/* the only operation used by the workload or -1 */
+	int op_fixed;
+	/* operations with a non-zero ratio */
+	bool op_used[NB_OP_MAX];
+	struct nb_plugin *plugin;
+	/* keys are spread over `shards` databases by a hash (--shards) */
+	struct nb_db **dbs;
+	size_t shards;
+	/* options of databases of shards, NULL for a single database */
+	struct nb_shard *shard_opts;
+	/* distribution of keys over the loaded set (--distribution) */
+	struct nb_random_dist dist;
+	/* lengths of keys */
+	struct nb_random_sizes key_sizes;
+	/* the size of records of keys, the longest key */
+	size_t key_size;
+	/* values of writes are slices of the pool */
+	struct nb_value_pool values;
+	pthread_mutex_t gate_lock;
+	pthread_cond_t gate_cond;
+	bool gate_open;
+	atomic_bool stop;
+	atomic_size_t running;
+	struct nb_worker *workers;
+	size_t workers_count;
+	/* per-interval samples (--samples) */
+	FILE *samples;
+	bool samples_json;
+	/* the parity selects interval histograms of workers */
+	atomic_uint epoch;
+	struct nb_histogram *sample_hist;
+	/* subtracted from latencies (--timer-subtract) */
+	uint64_t timer_overhead;
+	/* events which can be counted (--perf-counters) */
+	bool perf_supported[NB_PERF_MAX];
+	/* I/O before and after the run and at the last sample (--io-stats) */
+	struct nb_io io_begin;
+	struct nb_io io_end;
+	struct nb_io io_sample;
+	/* memory before the database is opened, after the run and at the
+	 * last sample, the peak RSS of the interval (--memory-stats) */
+	struct nb_mem mem_begin;
+	struct nb_mem mem_end;
+	struct nb_mem mem_sample;
+	uint64_t mem_interval_peak;
+	/* RSS of buffers and histograms of workers and of mapped keys */
+	uint64_t mem_harness;
+	/* worker i runs on cpus.ids[i % cpus.count] (--cpus) */
+	struct nb_cpus cpus;
+};
+
+#endif /* NB_ENGINE_INT_H_INCLUDED */
@@ -33,9 +33,21 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <math.h>
 #include <assert.h>
 
+/*
+ * Log-linear histogram in the spirit of HdrHistogram. Values are integer
+ * nanoseconds. Every power of two range [2^k, 2^(k+1)) is split into the
+ * same number of linear sub-buckets, which is enough to keep the requested
+ * number of significant decimal digits. The bucket of a value is found
+ * with a single count-leading-zeros instruction.
+ */
+
+/* Values above are counted in the last bucket, ~17 minutes */
+static const uint64_t NB_HISTOGRAM_HIGHEST = 1ULL << 40;
+
 /* Numbers were derived from leveldb benchmark to be compatible with it */
 static const double NB_HISTOGRAM_BUCKETS[] = {
 	1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 12, 14, 16, 18, 20, 25, 30, 35, 40, 45,
@@ -64,25 +76,99 @@ enum {
 };
 
 struct nb_histogram {
-	double min;
-	double max;
-	double sum;
+	uint64_t min;
+	uint64_t max;
+	uint64_t sum;
 	double sumsq;
 	size_t size;
-	size_t buckets[NB_HISTOGRAM_BUCKETS_COUNT];
 	int power;
+	int digits;
+	/* ns to output units (1e-power sec) */
+	double scale;
+	/* log2 of the number of sub-buckets in a half of a bucket */
+	int sub_half_magnitude;
+	uint64_t sub_half_count;
+	uint64_t sub_mask;
+	size_t counts_len;
+	uint64_t counts[];
 };
 
+static inline int
+nb_histogram_bucket_index(const struct nb_histogram *hist, uint64_t val)
+{
+	/* The mask keeps values below the first bucket in bucket 0 */
+	int pow2ceiling = 64 - __builtin_clzll(val | hist->sub_mask);
+	return pow2ceiling - (hist->sub_half_magnitude + 1);
+}
+
+static inline size_t
+nb_histogram_index(const struct nb_histogram *hist, uint64_t val)
+{
+	int bucket = nb_histogram_bucket_index(hist, val);
+	uint64_t sub = val >> bucket;
+	return ((size_t) (bucket + 1) << hist->sub_half_magnitude) +
+	       (sub - hist->sub_half_count);
+}
+
+/* The lowest value and the width of the range counted at `index` */
+static void
+nb_histogram_range(const struct nb_histogram *hist, size_t index,
+		   uint64_t *lowest, uint64_t *width)
+{
+	int bucket = (int) (index >> hist->sub_half_magnitude) - 1;
+	uint64_t sub = (index & (hist->sub_half_count - 1)) +
+		       hist->sub_half_count;
+	if (bucket < 0) {
+		sub -= hist->sub_half_count;
+		bucket = 0;
+	}
+
+	*lowest = sub << bucket;
+	*width = 1ULL << bucket;
+}
+
 struct nb_histogram *
-nb_histogram_new(int power)
+nb_histogram_new(int power, int digits)
 {
-	struct nb_histogram *hist = malloc(sizeof(*hist));
+	if (digits < 1 || digits > 5) {
+		fprintf(stderr, "Invalid number of significant digits: %d\n",
+			digits);
+		goto error;
+	}
+
+	/* Sub-buckets resolve 2 * 10^digits with a unit precision */
+	uint64_t largest = 2;
+	for (int i = 0; i < digits; i++)
+		largest *= 10;
+
+	int sub_magnitude = 0;
+	while ((1ULL << sub_magnitude) < largest)
+		sub_magnitude++;
+	uint64_t sub_count = 1ULL << sub_magnitude;
+
+	size_t buckets = 1;
+	uint64_t untrackable = sub_count;
+	while (untrackable <= NB_HISTOGRAM_HIGHEST) {
+		untrackable <<= 1;
+		buckets++;
+	}
+	size_t counts_len = (buckets + 1) * (sub_count / 2);
+
+	size_t size = sizeof(struct nb_histogram) +
+		      counts_len * sizeof(uint64_t);
+	struct nb_histogram *hist = malloc(size);
 	if (hist == NULL) {
-		fprintf(stderr, "malloc(%zu) failed", sizeof(*hist));
+		fprintf(stderr, "malloc(%zu) failed", size);
 		goto error;
 	}
 
 	hist->power = power;
+	hist->digits = digits;
+	hist->scale = pow(10, power - 9);
+	hist->sub_half_magnitude = sub_magnitude - 1;
+	hist->sub_half_count = sub_count / 2;
+	hist->sub_mask = sub_count - 1;
+	hist->counts_len = counts_len;
 	nb_histogram_clear(hist);
 	return hist;
 error:
@@ -96,83 +182,289 @@ nb_histogram_delete(struct nb_histogram *hist)
 }
 
 void
-nb_histogram_add(struct nb_histogram *hist, double val)
+nb_histogram_add(struct nb_histogram *hist, uint64_t ns)
 {
-	val *= pow(10, hist->power);
+	size_t index = nb_histogram_index(hist,
+		ns < NB_HISTOGRAM_HIGHEST ? ns : NB_HISTOGRAM_HIGHEST);
+	hist->counts[index]++;
 
-	size_t begin = 0;
-	size_t end = NB_HISTOGRAM_BUCKETS_COUNT-1;
-	size_t mid;
+	if (hist->min > ns) {
+		hist->min = ns;
+	}
+	if (hist->max < ns) {
+		hist->max = ns;
+	}
 
-	while(1) {
-		mid = begin / 2 + end / 2;
-		if (mid == begin) {
-			for (mid = end; mid > begin; mid--) {
-				if (NB_HISTOGRAM_BUCKETS[mid-1] < val) {
-					break;
-				}
-			}
-			break;
-		}
+	hist->sum += ns;
+	hist->sumsq += (double) ns * ns;
+	hist->size++;
+}
 
-		if (NB_HISTOGRAM_BUCKETS[mid-1] < val) {
-			begin = mid;
-		} else {
-			end = mid;
+void
+nb_histogram_clear(struct nb_histogram *hist)
+{
+	hist->min = UINT64_MAX;
+	hist->max = 0;
+	hist->sum = 0;
+	hist->sumsq = 0.0;
+	hist->size = 0;
+	memset(hist->counts, 0, hist->counts_len * sizeof(uint64_t));
+}
+
+size_t
+nb_histogram_size(const struct nb_histogram *hist)
+{
+	return hist->size;
+}
+
+size_t
+nb_histogram_footprint(const struct nb_histogram *hist)
+{
+	return sizeof(*hist) + hist->counts_len * sizeof(uint64_t);
+}
+
+double
+nb_histogram_max(const struct nb_histogram *hist)
+{
+	return hist->max * hist->scale;
+}
+
+void
+nb_histogram_merge(struct nb_histogram *dst, const struct nb_histogram *src)
+{
+	if (dst->digits == src->digits) {
+		for (size_t i = 0; i < dst->counts_len; i++) {
+			dst->counts[i] += src->counts[i];
 		}
-	};
+	} else {
+		/* Re-record every bucket of src with the precision of dst */
+		for (size_t i = 0; i < src->counts_len; i++) {
+			if (src->counts[i] == 0)
+				continue;
+			uint64_t lowest, width;
+			nb_histogram_range(src, i, &lowest, &width);
+			uint64_t val = lowest + width / 2;
+			if (val > NB_HISTOGRAM_HIGHEST)
+				val = NB_HISTOGRAM_HIGHEST;
+			dst->counts[nb_histogram_index(dst, val)] +=
+				src->counts[i];
+		}
+	}
 
-	if (hist->min > val) {
-		hist->min = val;
+	if (dst->min > src->min) {
+		dst->min = src->min;
 	}
-	if (hist->max < val) {
-		hist->max = val;
+	if (dst->max < src->max) {
+		dst->max = src->max;
 	}
 
-	hist->sum += val;
-	hist->sumsq += val * val;
+	dst->sum += src->sum;
+	dst->sumsq += src->sumsq;
+	dst->size += src->size;
+}
 
-	hist->buckets[mid]++;
-	hist->size++;
+/*
+ * Serialized format: a magic string followed by LEB128 varints - power
+ * (zigzag), digits, size, min, max, sum, bits of sumsq, the number of
+ * counts and the counts themselves. Counts are zigzag-encoded, a negative
+ * number -n stands for a run of n empty buckets.
+ */
+static const char NB_HISTOGRAM_MAGIC[4] = { 'N', 'B', 'H', '1' };
+
+static int
+nb_histogram_write_varint(FILE *file, uint64_t val)
+{
+	uint8_t buf[10];
+	size_t len = 0;
+	do {
+		buf[len] = val & 0x7f;
+		val >>= 7;
+		if (val != 0)
+			buf[len] |= 0x80;
+		len++;
+	} while (val != 0);
+
+	return fwrite(buf, 1, len, file) == len ? 0 : -1;
 }
 
-void
-nb_histogram_clear(struct nb_histogram *hist)
+static int
+nb_histogram_read_varint(FILE *file, uint64_t *val)
 {
-	int power = hist->power;
-	memset(hist, 0, sizeof(*hist));
-	hist->power = power;
-	hist->min = INFINITY;
+	*val = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		int c = fgetc(file);
+		if (c == EOF)
+			return -1;
+		*val |= (uint64_t) (c & 0x7f) << shift;
+		if ((c & 0x80) == 0)
+			return 0;
+	}
+
+	return -1;
 }
 
-static double
-nb_histogram_percentile(const struct nb_histogram *hist, double p)
+static inline uint64_t
+nb_histogram_zigzag(int64_t val)
 {
-	size_t threshold = (size_t) hist->size * p;
-	size_t count = 0;
+	return ((uint64_t) val << 1) ^ (uint64_t) (val >> 63);
+}
 
-	for (size_t b = 0; b < NB_HISTOGRAM_BUCKETS_COUNT; b++) {
-		count += hist->buckets[b];
-		if (count >= threshold) {
-			size_t left = count - hist->buckets[b];
-			size_t right = count;
-			double left_val = (b>0) ? NB_HISTOGRAM_BUCKETS[b-1] : 0;
-			double right_val = NB_HISTOGRAM_BUCKETS[b];
-			double scale = (double) (threshold - left) /
-				       (right - left);
-
-			double r = left_val + (right_val - left_val) * scale;
-			if (r < hist->min) {
-				return hist->min;
-			} else if (r > hist->max) {
-				return hist->max;
-			} else {
-				return r;
+static inline int64_t
+nb_histogram_unzigzag(uint64_t val)
+{
+	return (int64_t) (val >> 1) ^ -(int64_t) (val & 1);
+}
+
+int
+nb_histogram_save(const struct nb_histogram *hist, FILE *file)
+{
+	uint64_t sumsq;
+	memcpy(&sumsq, &hist->sumsq, sizeof(sumsq));
+
+	if (fwrite(NB_HISTOGRAM_MAGIC, sizeof(NB_HISTOGRAM_MAGIC), 1,
+		   file) != 1)
+		return -1;
+
+	uint64_t header[] = {
+		nb_histogram_zigzag(hist->power), hist->digits, hist->size,
+		hist->min, hist->max, hist->sum, sumsq, hist->counts_len,
+	};
+	for (size_t i = 0; i < sizeof(header) / sizeof(*header); i++) {
+		if (nb_histogram_write_varint(file, header[i]) != 0)
+			return -1;
+	}
+
+	for (size_t i = 0; i < hist->counts_len; ) {
+		int64_t val = (int64_t) hist->counts[i++];
+		if (val == 0) {
+			while (i < hist->counts_len && hist->counts[i] == 0) {
+				val--;
+				i++;
 			}
+			val--;
 		}
+		if (nb_histogram_write_varint(file,
+					      nb_histogram_zigzag(val)) != 0)
+			return -1;
 	}
 
-	return hist->max;
+	return 0;
+}
+
+struct nb_histogram *
+nb_histogram_load(FILE *file)
+{
+	char magic[sizeof(NB_HISTOGRAM_MAGIC)];
+	if (fread(magic, sizeof(magic), 1, file) != 1 ||
+	    memcmp(magic, NB_HISTOGRAM_MAGIC, sizeof(magic)) != 0) {
+		fprintf(stderr, "Invalid histogram header\n");
+		goto error_1;
+	}
+
+	uint64_t header[8];
+	for (size_t i = 0; i < sizeof(header) / sizeof(*header); i++) {
+		if (nb_histogram_read_varint(file, &header[i]) != 0) {
+			fprintf(stderr, "Truncated histogram header\n");
+			goto error_1;
+		}
+	}
+
+	int power = (int) nb_histogram_unzigzag(header[0]);
+	struct nb_histogram *hist = nb_histogram_new(power, (int) header[1]);
+	if (hist == NULL)
+		goto error_1;
+
+	if (header[7] != hist->counts_len) {
+		fprintf(stderr, "Invalid number of histogram buckets: %llu\n",
+			(unsigned long long) header[7]);
+		goto error_2;
+	}
+
+	hist->size = header[2];
+	hist->min = header[3];
+	hist->max = header[4];
+	hist->sum = header[5];
+	memcpy(&hist->sumsq, &header[6], sizeof(hist->sumsq));
+
+	for (size_t i = 0; i < hist->counts_len; ) {
+		uint64_t raw;
+		if (nb_histogram_read_varint(file, &raw) != 0) {
+			fprintf(stderr, "Truncated histogram\n");
+			goto error_2;
+		}
+
+		int64_t val = nb_histogram_unzigzag(raw);
+		if (val >= 0) {
+			hist->counts[i++] = (uint64_t) val;
+			continue;
+		}
+		/* negate unsigned: a corrupt file may hold INT64_MIN */
+		uint64_t run = (uint64_t) 0 - (uint64_t) val;
+		if (run > hist->counts_len - i) {
+			fprintf(stderr, "Invalid histogram bucket run\n");
+			goto error_2;
+		}
+		i += (size_t) run;
+	}
+
+	return hist;
+
+error_2:
+	nb_histogram_delete(hist);
+error_1:
+	return NULL;
+}
+
+double
+nb_histogram_percentile(const struct nb_histogram *hist, double p)
+{
+	if (hist->size == 0)
+		return 0.0;
+
+	size_t threshold = (size_t) ceil(hist->size * p);
+	if (threshold == 0)
+		threshold = 1;
+
+	size_t count = 0;
+	for (size_t i = 0; i < hist->counts_len; i++) {
+		count += hist->counts[i];
+		if (count < threshold)
+			continue;
+
+		/* The highest value equivalent to the ones counted here */
+		uint64_t lowest, width;
+		nb_histogram_range(hist, i, &lowest, &width);
+		uint64_t val = lowest + width - 1;
+		if (val < hist->min)
+			val = hist->min;
+		if (val > hist->max)
+			val = hist->max;
+		return val * hist->scale;
+	}
+
+	return hist->max * hist->scale;
+}
+
+/* Counts of the leveldb buckets used by nb_histogram_dump() */
+static void
+nb_histogram_legacy(const struct nb_histogram *hist, size_t *buckets)
+{
+	memset(buckets, 0, NB_HISTOGRAM_BUCKETS_COUNT * sizeof(*buckets));
+
+	for (size_t i = 0; i < hist->counts_len; i++) {
+		if (hist->counts[i] == 0)
+			continue;
+
+		uint64_t lowest, width;
+		nb_histogram_range(hist, i, &lowest, &width);
+		double val = (lowest + width / 2) * hist->scale;
+
+		size_t b = 0;
+		while (b < NB_HISTOGRAM_BUCKETS_COUNT - 1 &&
+		       NB_HISTOGRAM_BUCKETS[b] <= val)
+			b++;
+		buckets[b] += hist->counts[i];
+	}
 }
 
 void
@@ -180,17 +472,21 @@ nb_histogram_dump(const struct nb_histogram *hist, FILE *file,
 		  double *percentiles, size_t percentiles_size)
 {
 	assert (hist->size > 0);
+
+	size_t buckets[NB_HISTOGRAM_BUCKETS_COUNT];
+	nb_histogram_legacy(hist, buckets);
+
 	fprintf(file, "[%7s, %7s)\t%11s\t%7s\n", "t min", "t max",
 		"ops count", "%");
 	fprintf(file, "--------------------------------------------------\n");
 	for (size_t i = 0; i < NB_HISTOGRAM_BUCKETS_COUNT; i++) {
-		if (hist->buckets[i] == 0.0)
+		if (buckets[i] == 0)
 			continue;
-		double percents = (double) hist->buckets[i] / hist->size;
+		double percents = (double) buckets[i] / hist->size;
 		fprintf(file, "[%7.0lf, %7.0lf)\t%11zu\t%7.2lf ",
 			(i > 0) ? NB_HISTOGRAM_BUCKETS[i-1] : 0.0,
 			NB_HISTOGRAM_BUCKETS[i],
-			hist->buckets[i],
+			buckets[i],
 			percents * 1e2);
 
 		unsigned marks = (unsigned) percents * 1e2 / 5.0;
@@ -201,17 +497,18 @@ nb_histogram_dump(const struct nb_histogram *hist, FILE *file,
 		fputc('\n', file);
 	}
 
-	double avg_latency = hist->sum / hist->size;
+	double sum = hist->sum * hist->scale;
+	double avg_latency = sum / hist->size;
 
 	fprintf(file, "--------------------------------------------------\n");
 	fprintf(file, "Total:%5s%7.0lf\t%11zu\t   100%%\n", "",
-		hist->sum, hist->size);
+		sum, hist->size);
 	fprintf(file, "Min latency       : %7.6lf * 1e%d sec/op\n",
-		hist->min, -hist->power);
+		hist->min * hist->scale, -hist->power);
 	fprintf(file, "Avg latency       : %7.6lf * 1e%d sec/op\n",
 		avg_latency, -hist->power);
 	fprintf(file, "Max latency       : %7.6lf * 1e%d sec/op\n",
-		hist->max, -hist->power);
+		hist->max * hist->scale, -hist->power);
 
 	for (size_t i = 0; i < percentiles_size; i++) {
 		double p = percentiles[i];
@@ -219,6 +516,5 @@ nb_histogram_dump(const struct nb_histogram *hist, FILE *file,
 			p*1e2, nb_histogram_percentile(hist, p), -hist->power);
 	}
 	fprintf(file, "Avg throughput    : %7.0lf ops/sec\n",
-		(double) hist->size / (hist->sum * pow(10, -hist->power)));
+		(double) hist->size / (hist->sum * 1e-9));
 }
-
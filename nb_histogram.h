@@ -31,21 +31,54 @@
  */
 
 #include <stdio.h>
+#include <stdint.h>
 
 struct nb_histogram;
 
+/*
+ * Values are recorded in nanoseconds and reported in 1e-power sec units
+ * with `digits` significant decimal digits (1-5).
+ */
 struct nb_histogram *
-nb_histogram_new(int power);
+nb_histogram_new(int power, int digits);
 
 void
 nb_histogram_delete(struct nb_histogram *hist);
 
 void
-nb_histogram_add(struct nb_histogram *hist, double val);
+nb_histogram_add(struct nb_histogram *hist, uint64_t ns);
 
 void
 nb_histogram_clear(struct nb_histogram *hist);
 
+size_t
+nb_histogram_size(const struct nb_histogram *hist);
+
+/* Bytes of memory taken by the histogram */
+size_t
+nb_histogram_footprint(const struct nb_histogram *hist);
+
+double
+nb_histogram_max(const struct nb_histogram *hist);
+
+/*
+ * Add all values of src to dst. Histograms may have different precision,
+ * then src is re-recorded with the precision of dst.
+ */
+void
+nb_histogram_merge(struct nb_histogram *dst, const struct nb_histogram *src);
+
+/* Write a compact, portable encoding of the histogram */
+int
+nb_histogram_save(const struct nb_histogram *hist, FILE *file);
+
+/* Read a histogram written by nb_histogram_save() */
+struct nb_histogram *
+nb_histogram_load(FILE *file);
+
+double
+nb_histogram_percentile(const struct nb_histogram *hist, double p);
+
 void
 nb_histogram_dump(const struct nb_histogram *hist, FILE *file,
 		  double *percentiles, size_t percentiles_size);
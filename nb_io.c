@@ -0,0 +1,113 @@
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#define _XOPEN_SOURCE 700 /* nftw() */
+
+#include "nb_io.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <ftw.h>
+#include <sys/stat.h>
+
+/* nftw() has no argument for the callback */
+static uint64_t nb_io_walk_size;
+
+static int
+nb_io_walk(const char *path, const struct stat *st, int type,
+	   struct FTW *ftw)
+{
+	(void) path;
+	(void) ftw;
+
+	if (type == FTW_F)
+		nb_io_walk_size += (uint64_t) st->st_blocks * 512;
+	return 0;
+}
+
+static int
+nb_io_read_proc(struct nb_io *io)
+{
+	FILE *file = fopen("/proc/self/io", "r");
+	if (file == NULL) {
+		perror("fopen(/proc/self/io)");
+		return -1;
+	}
+
+	static const struct {
+		const char *name;
+		size_t offset;
+	} fields[] = {
+		{ "rchar", offsetof(struct nb_io, rchar) },
+		{ "wchar", offsetof(struct nb_io, wchar) },
+		{ "syscr", offsetof(struct nb_io, syscr) },
+		{ "syscw", offsetof(struct nb_io, syscw) },
+		{ "read_bytes", offsetof(struct nb_io, read_bytes) },
+		{ "write_bytes", offsetof(struct nb_io, write_bytes) },
+		{ "cancelled_write_bytes",
+		  offsetof(struct nb_io, cancelled_write_bytes) },
+	};
+
+	int found = 0;
+	char name[64];
+	unsigned long long value;
+	while (fscanf(file, "%63[^:]: %llu\n", name, &value) == 2) {
+		for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]);
+		     i++) {
+			if (strcmp(fields[i].name, name) != 0)
+				continue;
+			*(uint64_t *) ((char *) io + fields[i].offset) = value;
+			found++;
+		}
+	}
+	fclose(file);
+
+	if (found < 6) {
+		fprintf(stderr, "/proc/self/io has no block I/O counters\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+int
+nb_io_read(struct nb_io *io, const char *path)
+{
+	memset(io, 0, sizeof(*io));
+	if (nb_io_read_proc(io) != 0)
+		return -1;
+
+	/* The database may not exist yet */
+	nb_io_walk_size = 0;
+	nftw(path, nb_io_walk, 16, FTW_PHYS);
+	io->disk_size = nb_io_walk_size;
+
+	return 0;
+}
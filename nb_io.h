@@ -0,0 +1,63 @@
+#ifndef NB_IO_H_INCLUDED
+#define NB_IO_H_INCLUDED
+
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+
+/* I/O of the process from /proc/self/io and the size of a directory */
+struct nb_io {
+	/* bytes passed to read() and write()-like syscalls */
+	uint64_t rchar;
+	uint64_t wchar;
+	uint64_t syscr;
+	uint64_t syscw;
+	/* bytes read from and written to the storage layer */
+	uint64_t read_bytes;
+	uint64_t write_bytes;
+	/* dirty page cache truncated before it was written back */
+	uint64_t cancelled_write_bytes;
+	/* space allocated on disk for files under the path */
+	uint64_t disk_size;
+};
+
+/* Read I/O counters of the process and the disk usage of `path` */
+int
+nb_io_read(struct nb_io *io, const char *path);
+
+/* Bytes written to the storage layer less cancelled writes */
+static inline uint64_t
+nb_io_device_writes(const struct nb_io *io)
+{
+	return io->write_bytes > io->cancelled_write_bytes ?
+	       io->write_bytes - io->cancelled_write_bytes : 0;
+}
+
+#endif /* NB_IO_H_INCLUDED */
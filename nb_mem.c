@@ -0,0 +1,150 @@
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#define _XOPEN_SOURCE 700 /* realpath() */
+
+#include "nb_mem.h"
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/resource.h>
+
+/* Read "Name: value kB" fields of a /proc file into `mem` */
+static int
+nb_mem_read_fields(const char *filename, struct nb_mem *mem,
+		   const char **names, const size_t *offsets, size_t count)
+{
+	FILE *file = fopen(filename, "r");
+	if (file == NULL) {
+		fprintf(stderr, "fopen(%s) failed\n", filename);
+		return -1;
+	}
+
+	size_t found = 0;
+	char line[256];
+	while (fgets(line, sizeof(line), file) != NULL) {
+		for (size_t i = 0; i < count; i++) {
+			size_t len = strlen(names[i]);
+			if (strncmp(line, names[i], len) != 0 ||
+			    line[len] != ':')
+				continue;
+			unsigned long long kb = 0;
+			sscanf(line + len + 1, "%llu", &kb);
+			*(uint64_t *) ((char *) mem + offsets[i]) = kb * 1024;
+			found++;
+		}
+	}
+	fclose(file);
+
+	if (found < count) {
+		fprintf(stderr, "%s has no memory counters\n", filename);
+		return -1;
+	}
+
+	return 0;
+}
+
+int
+nb_mem_read(struct nb_mem *mem)
+{
+	static const char *names[] = {
+		"VmRSS", "VmHWM", "RssAnon", "RssFile", "RssShmem"
+	};
+	static const size_t offsets[] = {
+		offsetof(struct nb_mem, rss),
+		offsetof(struct nb_mem, rss_peak),
+		offsetof(struct nb_mem, rss_anon),
+		offsetof(struct nb_mem, rss_file),
+		offsetof(struct nb_mem, rss_shmem),
+	};
+
+	if (nb_mem_read_fields("/proc/self/status", mem, names, offsets,
+			       sizeof(names) / sizeof(names[0])) != 0)
+		return -1;
+
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		perror("getrusage");
+		return -1;
+	}
+	mem->minflt = usage.ru_minflt;
+	mem->majflt = usage.ru_majflt;
+
+	return 0;
+}
+
+int
+nb_mem_read_pss(struct nb_mem *mem)
+{
+	static const char *names[] = { "Pss" };
+	static const size_t offsets[] = { offsetof(struct nb_mem, pss) };
+
+	return nb_mem_read_fields("/proc/self/smaps_rollup", mem, names,
+				  offsets, 1);
+}
+
+int
+nb_mem_read_mapped(const char *filename, uint64_t *rss)
+{
+	char path[PATH_MAX];
+	if (realpath(filename, path) == NULL) {
+		perror(filename);
+		return -1;
+	}
+
+	FILE *file = fopen("/proc/self/smaps", "r");
+	if (file == NULL) {
+		fprintf(stderr, "fopen(/proc/self/smaps) failed\n");
+		return -1;
+	}
+
+	*rss = 0;
+	bool mapped = false;
+	char line[PATH_MAX + 256];
+	while (fgets(line, sizeof(line), file) != NULL) {
+		/* A mapping starts with "start-end perms offset dev inode" */
+		unsigned long long start, end, kb;
+		int pos = 0;
+		if (sscanf(line, "%llx-%llx %*s %*s %*s %*s %n", &start, &end,
+			   &pos) == 2 && pos > 0) {
+			line[strcspn(line, "\n")] = 0;
+			mapped = strcmp(line + pos, path) == 0;
+			continue;
+		}
+		if (mapped && sscanf(line, "Rss: %llu kB", &kb) == 1)
+			*rss += kb * 1024;
+	}
+	fclose(file);
+
+	return 0;
+}
@@ -0,0 +1,61 @@
+#ifndef NB_MEM_H_INCLUDED
+#define NB_MEM_H_INCLUDED
+
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+
+/* Memory footprint of the process, in bytes */
+struct nb_mem {
+	uint64_t rss;
+	uint64_t rss_peak;
+	uint64_t rss_anon;
+	uint64_t rss_file;
+	uint64_t rss_shmem;
+	/* proportional set size, read by nb_mem_read_pss() only */
+	uint64_t pss;
+	/* page faults since the start of the process */
+	uint64_t minflt;
+	uint64_t majflt;
+};
+
+/* Read /proc/self/status and getrusage(), cheap enough to poll */
+int
+nb_mem_read(struct nb_mem *mem);
+
+/* Read PSS from /proc/self/smaps_rollup, which walks page tables */
+int
+nb_mem_read_pss(struct nb_mem *mem);
+
+/* RSS of all mappings of the file, from /proc/self/smaps */
+int
+nb_mem_read_mapped(const char *filename, uint64_t *rss);
+
+#endif /* NB_MEM_H_INCLUDED */
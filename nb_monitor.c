@@ -0,0 +1,292 @@
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "nb_monitor.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+
+#include "nb_engine_int.h"
+#include "nb_histogram.h"
+#include "nb_time.h"
+
+static size_t
+nb_monitor_done(struct nb_engine *engine)
+{
+	size_t done = 0;
+	for (size_t i = 0; i < engine->workers_count; i++) {
+		done += atomic_load_explicit(&engine->workers[i].done,
+					     memory_order_relaxed);
+	}
+
+	return done;
+}
+
+/* Counts of events per op in the sample interval */
+static void
+nb_monitor_sample_perf(struct nb_engine *engine, size_t ops)
+{
+	struct nb_perf_counts total;
+	memset(&total, 0, sizeof(total));
+
+	for (size_t i = 0; i < engine->workers_count; i++) {
+		struct nb_worker *w = &engine->workers[i];
+		struct nb_perf_counts counts;
+		nb_perf_read(&w->perf, &counts);
+		for (int e = 0; e < NB_PERF_MAX; e++) {
+			total.value[e] += counts.value[e] -
+					  w->perf_sample.value[e];
+		}
+		w->perf_sample = counts;
+	}
+
+	for (int e = 0; e < NB_PERF_MAX; e++) {
+		double per_op = ops > 0 ? (double) total.value[e] / ops : 0.0;
+		if (engine->samples_json) {
+			fprintf(engine->samples, ", \"%s\": %.3lf",
+				nb_perf_event_names[e], per_op);
+		} else {
+			fprintf(engine->samples, ",%.3lf", per_op);
+		}
+	}
+}
+
+/* Device I/O in the sample interval and the size of the database */
+static void
+nb_monitor_sample_io(struct nb_engine *engine)
+{
+	struct nb_io io;
+	if (nb_io_read(&io, engine->opts->db_opts.path) != 0)
+		io = engine->io_sample;
+
+	unsigned long long read_bytes =
+		io.read_bytes - engine->io_sample.read_bytes;
+	unsigned long long write_bytes = nb_io_device_writes(&io) -
+		nb_io_device_writes(&engine->io_sample);
+	unsigned long long disk_size = io.disk_size;
+	engine->io_sample = io;
+
+	if (engine->samples_json) {
+		fprintf(engine->samples, ", \"read_bytes\": %llu, "
+			"\"write_bytes\": %llu, \"disk_size\": %llu",
+			read_bytes, write_bytes, disk_size);
+	} else {
+		fprintf(engine->samples, ",%llu,%llu,%llu", read_bytes,
+			write_bytes, disk_size);
+	}
+}
+
+/* Track the peak RSS between samples */
+static void
+nb_monitor_poll_memory(struct nb_engine *engine)
+{
+	struct nb_mem mem;
+	if (nb_mem_read(&mem) == 0 && mem.rss > engine->mem_interval_peak)
+		engine->mem_interval_peak = mem.rss;
+}
+
+/* Memory at the end of the sample interval and faults in it */
+static void
+nb_monitor_sample_memory(struct nb_engine *engine)
+{
+	struct nb_mem mem;
+	if (nb_mem_read(&mem) != 0)
+		mem = engine->mem_sample;
+
+	unsigned long long peak = engine->mem_interval_peak > mem.rss ?
+				  engine->mem_interval_peak : mem.rss;
+	unsigned long long minflt = mem.minflt - engine->mem_sample.minflt;
+	unsigned long long majflt = mem.majflt - engine->mem_sample.majflt;
+	engine->mem_sample = mem;
+	engine->mem_interval_peak = 0;
+
+	if (engine->samples_json) {
+		fprintf(engine->samples, ", \"rss\": %llu, \"rss_peak\": %llu, "
+			"\"rss_anon\": %llu, \"rss_file\": %llu, "
+			"\"minflt\": %llu, \"majflt\": %llu",
+			(unsigned long long) mem.rss, peak,
+			(unsigned long long) mem.rss_anon,
+			(unsigned long long) mem.rss_file, minflt, majflt);
+	} else {
+		fprintf(engine->samples, ",%llu,%llu,%llu,%llu,%llu,%llu",
+			(unsigned long long) mem.rss, peak,
+			(unsigned long long) mem.rss_anon,
+			(unsigned long long) mem.rss_file, minflt, majflt);
+	}
+}
+
+/*
+ * Write a sample of the interval which ended at `now`. Workers are
+ * switched to the other set of interval histograms first, so the
+ * previous set can be read and cleared while they go on.
+ */
+static void
+nb_monitor_sample(struct nb_engine *engine, double start, double prev,
+		  double now)
+{
+	struct nb_histogram *hist = engine->sample_hist;
+	unsigned epoch = atomic_fetch_add(&engine->epoch, 1);
+
+	nb_histogram_clear(hist);
+	for (size_t i = 0; i < engine->workers_count; i++) {
+		struct nb_worker *w = &engine->workers[i];
+		/* The worker may be preempted mid-add on a shared CPU */
+		while (atomic_load(&w->sampling))
+			sched_yield();
+		nb_histogram_merge(hist, w->interval[epoch & 1]);
+		nb_histogram_clear(w->interval[epoch & 1]);
+	}
+
+	size_t ops = nb_histogram_size(hist);
+	double rate = now > prev ? ops / (now - prev) : 0.0;
+	double p50 = ops > 0 ? nb_histogram_percentile(hist, 0.50) : 0.0;
+	double p99 = ops > 0 ? nb_histogram_percentile(hist, 0.99) : 0.0;
+	double p999 = ops > 0 ? nb_histogram_percentile(hist, 0.999) : 0.0;
+	double max = ops > 0 ? nb_histogram_max(hist) : 0.0;
+
+	/* Latencies are in 1e-6 sec, as in the final report */
+	if (engine->samples_json) {
+		fprintf(engine->samples, "{\"time\": %.6lf, \"elapsed\": %.6lf, "
+			"\"ops\": %zu, \"ops_per_sec\": %.1lf, \"p50\": %.6lf, "
+			"\"p99\": %.6lf, \"p999\": %.6lf, \"max\": %.6lf",
+			nb_now(), now - start, ops, rate, p50, p99, p999, max);
+	} else {
+		fprintf(engine->samples, "%.6lf,%.6lf,%zu,%.1lf,%.6lf,%.6lf,"
+			"%.6lf,%.6lf", nb_now(), now - start, ops, rate,
+			p50, p99, p999, max);
+	}
+
+	if (engine->opts->perf_counters)
+		nb_monitor_sample_perf(engine, ops);
+	if (engine->opts->io_stats)
+		nb_monitor_sample_io(engine);
+	if (engine->opts->memory_stats)
+		nb_monitor_sample_memory(engine);
+
+	fprintf(engine->samples, engine->samples_json ? "}\n" : "\n");
+}
+
+int
+nb_monitor_open_samples(struct nb_engine *engine)
+{
+	const char *filename = engine->opts->samples;
+	int rc = 0;
+
+	rc--;
+	engine->sample_hist = nb_histogram_new(6, engine->opts->hist_digits);
+	if (engine->sample_hist == NULL) {
+		fprintf(stderr, "nb_histogram_new() failed\n");
+		goto error_1;
+	}
+
+	rc--;
+	engine->samples = fopen(filename, "w");
+	if (engine->samples == NULL) {
+		perror("fopen");
+		goto error_2;
+	}
+
+	const char *ext = strrchr(filename, '.');
+	engine->samples_json = ext != NULL &&
+		(strcmp(ext, ".json") == 0 || strcmp(ext, ".jsonl") == 0);
+	if (!engine->samples_json) {
+		fprintf(engine->samples, "time,elapsed,ops,ops_per_sec,"
+			"p50,p99,p999,max");
+		for (int e = 0; engine->opts->perf_counters &&
+				e < NB_PERF_MAX; e++) {
+			fprintf(engine->samples, ",%s", nb_perf_event_names[e]);
+		}
+		if (engine->opts->io_stats) {
+			fprintf(engine->samples,
+				",read_bytes,write_bytes,disk_size");
+		}
+		if (engine->opts->memory_stats) {
+			fprintf(engine->samples, ",rss,rss_peak,rss_anon,"
+				"rss_file,minflt,majflt");
+		}
+		fprintf(engine->samples, "\n");
+	}
+	atomic_init(&engine->epoch, 0);
+
+	return 0;
+
+error_2:
+	nb_histogram_delete(engine->sample_hist);
+error_1:
+	return rc;
+}
+
+void
+nb_monitor_close_samples(struct nb_engine *engine)
+{
+	fclose(engine->samples);
+	nb_histogram_delete(engine->sample_hist);
+}
+
+void
+nb_monitor_run(struct nb_engine *engine)
+{
+	struct nb_opts *opts = engine->opts;
+	const struct timespec period = { 0, 10 * 1000 * 1000 };
+
+	double start = nb_clock();
+	double prev = start;
+	size_t next_report = opts->report_interval;
+	while (atomic_load(&engine->running) > 0) {
+		nanosleep(&period, NULL);
+
+		if (opts->memory_stats)
+			nb_monitor_poll_memory(engine);
+
+		double now = nb_clock();
+		if (engine->samples != NULL &&
+		    now - prev >= opts->sample_interval) {
+			nb_monitor_sample(engine, start, prev, now);
+			prev = now;
+		}
+
+		size_t total_count = nb_monitor_done(engine);
+		if (opts->report_interval == 0 || total_count < next_report)
+			continue;
+
+		fprintf(stderr, "\r%zu ops done...", total_count);
+		next_report = total_count - total_count % opts->report_interval +
+			      opts->report_interval;
+	}
+
+	fprintf(stderr, "\r%zu ops done...\n", nb_monitor_done(engine));
+
+	/* The last, possibly incomplete, interval */
+	double now = nb_clock();
+	if (engine->samples != NULL && now > prev) {
+		nb_monitor_sample(engine, start, prev, now);
+	}
+}
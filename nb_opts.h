@@ -31,18 +31,98 @@
  */
 
 #include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <limits.h>
 
 #include "nb_plugin_api.h"
+#include "nb_cpu.h"
+#include "nb_random.h"
+#include "nb_time.h"
 
 struct nb_opts {
 	struct nb_db_opts db_opts;
 
+	/* the size of keys, the maximal size for distributions */
 	size_t key_len;
+	size_t key_len_min;
+	enum nb_size_type key_size;
+	/* key sizes and weights for empirical distribution */
+	char *key_sizes;
+	/* the size of values, the maximal size for distributions */
 	size_t val_len;
+	size_t val_len_min;
+	enum nb_size_type value_size;
+	/* value sizes and weights for empirical distribution */
+	char *value_sizes;
+	/* target compressed size / size of values */
+	double compression_ratio;
 
 	size_t report_interval;
 	size_t count;
+	size_t threads;
+	/* target throughput in ops/sec for open-loop mode, 0 - closed-loop */
+	size_t rate;
+	/* proportions of operations in the mixed workload */
+	double read_ratio;
+	double update_ratio;
+	double scan_ratio;
+	/* maximal number of records read by a range scan */
+	size_t scan_length;
+	/* number of records in a write batch */
+	size_t batch;
+	/* number of delete/insert pairs issued by the churn workload */
+	size_t churn_ops;
+	/* number of asynchronous requests in flight per thread, 0 - sync */
+	size_t queue_depth;
+	/* number of databases keys are spread over, 1 - a single database */
+	size_t shards;
+	/* every thread works with keys of one shard only */
+	bool shard_threads;
+	/* run time limit in seconds, 0 - run until --count keys are used */
+	double duration;
+	/* warm-up ops are executed, but not reported */
+	double warmup;
+	size_t warmup_ops;
+	/* file for per-interval samples, CSV or JSON lines (*.json) */
+	char *samples;
+	double sample_interval;
+	uint64_t seed;
+	/* keys are read from keys_filename or generated from the seed */
+	enum nb_key_format key_format;
+	/* GETs read values and check them against the expected ones */
+	bool verify;
+	/* GETs copy values into a preallocated buffer */
+	bool select_into;
+	/* source of timestamps, the cost of reading it is subtracted */
+	enum nb_timer_type timer;
+	bool timer_subtract;
+	/* count hardware events of worker threads */
+	bool perf_counters;
+	/* report I/O and space amplification */
+	bool io_stats;
+	/* report RSS and page faults */
+	bool memory_stats;
+	/* CPUs to run workers on, e.g. "0-3,8", NULL - any */
+	char *cpus;
+	/* memory policy, numa_node is used by NB_NUMA_NODE */
+	enum nb_numa_policy numa_policy;
+	int numa_node;
+	/* read the first --count records in a permutation of --seed */
+	bool read_permuted;
+	/* distribution of keys over the first --count records */
+	enum nb_random_type distribution;
+	double zipf_theta;
+	/* hotspot: hot_ops of ops go to hot_keys of keys */
+	double hot_keys;
+	double hot_ops;
+	/* number of significant decimal digits kept by latency histograms */
+	int hist_digits;
+	/* file to save latency histograms to, see nb_report_merge() */
+	char *histogram_out;
+	/* histogram files combined by the merge action */
+	char **merge_files;
+	size_t merge_files_count;
 
 	char *path;
 	char *driver;
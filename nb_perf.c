@@ -0,0 +1,146 @@
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE /* syscall() */
+
+#include "nb_perf.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+const char *nb_perf_event_names[NB_PERF_MAX] = {
+	[NB_PERF_CYCLES] = "cycles",
+	[NB_PERF_INSTRUCTIONS] = "instructions",
+	[NB_PERF_LLC_MISSES] = "llc-misses",
+	[NB_PERF_BRANCH_MISSES] = "branch-misses",
+	[NB_PERF_DTLB_MISSES] = "dtlb-misses",
+	[NB_PERF_PAGE_FAULTS] = "page-faults",
+};
+
+static const struct {
+	uint32_t type;
+	uint64_t config;
+} nb_perf_events[NB_PERF_MAX] = {
+	[NB_PERF_CYCLES] = {
+		PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	[NB_PERF_INSTRUCTIONS] = {
+		PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	[NB_PERF_LLC_MISSES] = {
+		PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+	[NB_PERF_BRANCH_MISSES] = {
+		PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+	[NB_PERF_DTLB_MISSES] = {
+		PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+		(PERF_COUNT_HW_CACHE_OP_READ << 8) |
+		(PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+	[NB_PERF_PAGE_FAULTS] = {
+		PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+};
+
+static int
+nb_perf_event_open(enum nb_perf_event event, int group, bool user_only)
+{
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = nb_perf_events[event].type;
+	attr.config = nb_perf_events[event].config;
+	attr.disabled = 1;
+	attr.exclude_hv = 1;
+	attr.exclude_kernel = user_only;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+			   PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+	return (int) syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+int
+nb_perf_open(struct nb_perf *perf)
+{
+	int opened = 0;
+	int group = -1;
+
+	for (int e = 0; e < NB_PERF_MAX; e++) {
+		/* Kernel events may be forbidden by perf_event_paranoid */
+		int fd = nb_perf_event_open(e, group, false);
+		if (fd < 0)
+			fd = nb_perf_event_open(e, group, true);
+		/* The event can't be scheduled together with the group */
+		if (fd < 0 && group >= 0)
+			fd = nb_perf_event_open(e, -1, true);
+		perf->fd[e] = fd;
+		if (fd < 0)
+			continue;
+		if (group < 0)
+			group = fd;
+		opened++;
+	}
+
+	return opened;
+}
+
+void
+nb_perf_close(struct nb_perf *perf)
+{
+	/* Members first, the leader is the first open event */
+	for (int e = NB_PERF_MAX - 1; e >= 0; e--) {
+		if (perf->fd[e] >= 0)
+			close(perf->fd[e]);
+		perf->fd[e] = -1;
+	}
+}
+
+void
+nb_perf_enable(struct nb_perf *perf)
+{
+	for (int e = 0; e < NB_PERF_MAX; e++) {
+		if (perf->fd[e] >= 0)
+			ioctl(perf->fd[e], PERF_EVENT_IOC_ENABLE, 0);
+	}
+}
+
+void
+nb_perf_read(const struct nb_perf *perf, struct nb_perf_counts *counts)
+{
+	for (int e = 0; e < NB_PERF_MAX; e++) {
+		/* value, time enabled, time running */
+		uint64_t buf[3];
+		counts->value[e] = 0;
+		if (perf->fd[e] < 0 ||
+		    read(perf->fd[e], buf, sizeof(buf)) != sizeof(buf))
+			continue;
+		if (buf[2] > 0 && buf[2] < buf[1])
+			buf[0] = (uint64_t) ((double) buf[0] * buf[1] / buf[2]);
+		counts->value[e] = buf[0];
+	}
+}
@@ -0,0 +1,89 @@
+#ifndef NB_PERF_H_INCLUDED
+#define NB_PERF_H_INCLUDED
+
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Events counted with --perf-counters */
+enum nb_perf_event {
+	NB_PERF_CYCLES,
+	NB_PERF_INSTRUCTIONS,
+	/* last level cache misses */
+	NB_PERF_LLC_MISSES,
+	NB_PERF_BRANCH_MISSES,
+	/* data TLB misses on loads */
+	NB_PERF_DTLB_MISSES,
+	NB_PERF_PAGE_FAULTS,
+	NB_PERF_MAX
+};
+
+extern const char *nb_perf_event_names[NB_PERF_MAX];
+
+/*
+ * A group of counters of a thread. Events the CPU or the kernel doesn't
+ * support have fd -1 and count as 0.
+ */
+struct nb_perf {
+	int fd[NB_PERF_MAX];
+};
+
+struct nb_perf_counts {
+	uint64_t value[NB_PERF_MAX];
+};
+
+/*
+ * Open disabled counters for the calling thread. Returns the number of
+ * events opened.
+ */
+int
+nb_perf_open(struct nb_perf *perf);
+
+void
+nb_perf_close(struct nb_perf *perf);
+
+void
+nb_perf_enable(struct nb_perf *perf);
+
+/*
+ * Read counters of the thread, from any thread. Counts of events which
+ * were multiplexed with others are scaled to the enabled time.
+ */
+void
+nb_perf_read(const struct nb_perf *perf, struct nb_perf_counts *counts);
+
+static inline bool
+nb_perf_has(const struct nb_perf *perf, enum nb_perf_event event)
+{
+	return perf->fd[event] >= 0;
+}
+
+#endif /* NB_PERF_H_INCLUDED */
@@ -42,8 +42,41 @@ struct nb_db {
 	const struct nb_db_opts *opts;
 };
 
+/* Plugin-defined cursor */
+struct nb_db_cursor;
+
 struct nb_db_opts {
 	const char *path;
+	/* number of threads that will use the database concurrently */
+	size_t threads;
+	/* number of records in a write batch, 1 - batches are not used */
+	size_t batch;
+};
+
+struct nb_db_record {
+	const void *key;
+	size_t key_len;
+	const void *val;
+	size_t val_len;
+};
+
+/* Plugin-defined queue of asynchronous requests */
+struct nb_db_queue;
+
+enum nb_db_req_type {
+	NB_DB_REQ_SELECT,
+	NB_DB_REQ_REPLACE,
+	NB_DB_REQ_REMOVE
+};
+
+struct nb_db_req {
+	enum nb_db_req_type type;
+	const void *key;
+	size_t key_len;
+	const void *val;
+	size_t val_len;
+	/* the result of the request, set on completion */
+	int rc;
 };
 
 typedef struct nb_db *
@@ -66,6 +99,62 @@ typedef int
 typedef void
 (*nb_db_valfree_t)(struct nb_db *db, void *val);
 
+/*
+ * Select into a caller-provided buffer (optional). Copies the value into
+ * `buf` of `buf_size` bytes without allocating memory. *pval_len is set
+ * to the length of the value. Returns 0 on success, 1 if the value doesn't
+ * fit into the buffer (it's truncated) and -1 on error.
+ */
+typedef int
+(*nb_db_select_into_t)(struct nb_db *db, const void *key, size_t key_len,
+		       void *buf, size_t buf_size, size_t *pval_len);
+
+/*
+ * Batched writes (optional). Stores all records using the native batch API
+ * of the engine.
+ */
+typedef int
+(*nb_db_write_batch_t)(struct nb_db *db, const struct nb_db_record *records,
+		       size_t count);
+
+/*
+ * Cursors (optional). cursor_seek() opens a cursor positioned at the first
+ * record that is greater or equal to the key. cursor_next() returns the
+ * current record and advances the cursor: 0 on success, 1 if there are no
+ * more records and -1 on error. Returned pointers are owned by the cursor
+ * and are valid until the next call on it.
+ */
+typedef struct nb_db_cursor *
+(*nb_db_cursor_seek_t)(struct nb_db *db, const void *key, size_t key_len);
+
+typedef int
+(*nb_db_cursor_next_t)(struct nb_db_cursor *cursor,
+		       const void **pkey, size_t *pkey_len,
+		       const void **pval, size_t *pval_len);
+
+typedef void
+(*nb_db_cursor_close_t)(struct nb_db_cursor *cursor);
+
+/*
+ * Asynchronous requests (optional). queue_open() creates a queue for at
+ * most `depth` outstanding requests. Requests are owned by the caller
+ * until they are returned by queue_poll(), which blocks until at least
+ * one request is completed and returns the number of completed requests.
+ * A queue is used by a single thread.
+ */
+typedef struct nb_db_queue *
+(*nb_db_queue_open_t)(struct nb_db *db, size_t depth);
+
+typedef int
+(*nb_db_queue_submit_t)(struct nb_db_queue *queue, struct nb_db_req *req);
+
+typedef size_t
+(*nb_db_queue_poll_t)(struct nb_db_queue *queue, struct nb_db_req **reqs,
+		      size_t count);
+
+typedef void
+(*nb_db_queue_close_t)(struct nb_db_queue *queue);
+
 struct nb_db_if {
 	const char *name;
 	nb_db_open_t open;
@@ -74,6 +163,15 @@ struct nb_db_if {
 	nb_db_remove_t remove;
 	nb_db_select_t select;
 	nb_db_valfree_t valfree;
+	nb_db_select_into_t select_into;
+	nb_db_write_batch_t write_batch;
+	nb_db_cursor_seek_t cursor_seek;
+	nb_db_cursor_next_t cursor_next;
+	nb_db_cursor_close_t cursor_close;
+	nb_db_queue_open_t queue_open;
+	nb_db_queue_submit_t queue_submit;
+	nb_db_queue_poll_t queue_poll;
+	nb_db_queue_close_t queue_close;
 };
 
 #if defined(__cplusplus)
@@ -0,0 +1,284 @@
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "nb_queue.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+struct nb_queue {
+	const struct nb_db_if *pif;
+	struct nb_db *db;
+	size_t depth;
+	/* the native queue of the driver, NULL if the pool is used */
+	struct nb_db_queue *native;
+
+	/* fallback thread pool */
+	pthread_mutex_t lock;
+	pthread_cond_t submit_cond;
+	pthread_cond_t complete_cond;
+	/* ring buffers of submitted and completed requests */
+	struct nb_db_req **submitted;
+	size_t submitted_head;
+	size_t submitted_count;
+	struct nb_db_req **completed;
+	size_t completed_head;
+	size_t completed_count;
+	/* number of requests owned by the queue */
+	size_t pending;
+	bool stop;
+	pthread_t *threads;
+	size_t threads_count;
+};
+
+bool
+nb_queue_is_native(const struct nb_db_if *pif)
+{
+	return pif->queue_open != NULL && pif->queue_submit != NULL &&
+	       pif->queue_poll != NULL && pif->queue_close != NULL;
+}
+
+static int
+nb_queue_exec(struct nb_queue *queue, struct nb_db_req *req)
+{
+	const struct nb_db_if *pif = queue->pif;
+
+	switch (req->type) {
+	case NB_DB_REQ_SELECT:
+		return pif->select(queue->db, req->key, req->key_len,
+				   NULL, NULL);
+	case NB_DB_REQ_REPLACE:
+		return pif->replace(queue->db, req->key, req->key_len,
+				    req->val, req->val_len);
+	case NB_DB_REQ_REMOVE:
+		return pif->remove(queue->db, req->key, req->key_len);
+	default:
+		return -1;
+	}
+}
+
+static void *
+nb_queue_thread(void *arg)
+{
+	struct nb_queue *queue = (struct nb_queue *) arg;
+	size_t depth = queue->depth;
+
+	pthread_mutex_lock(&queue->lock);
+	while (true) {
+		while (queue->submitted_count == 0 && !queue->stop)
+			pthread_cond_wait(&queue->submit_cond, &queue->lock);
+		if (queue->submitted_count == 0)
+			break;
+
+		struct nb_db_req *req = queue->submitted[queue->submitted_head];
+		queue->submitted_head = (queue->submitted_head + 1) % depth;
+		queue->submitted_count--;
+		pthread_mutex_unlock(&queue->lock);
+
+		req->rc = nb_queue_exec(queue, req);
+
+		pthread_mutex_lock(&queue->lock);
+		size_t tail = (queue->completed_head + queue->completed_count) %
+			      depth;
+		queue->completed[tail] = req;
+		queue->completed_count++;
+		pthread_cond_signal(&queue->complete_cond);
+	}
+	pthread_mutex_unlock(&queue->lock);
+
+	return NULL;
+}
+
+static void
+nb_queue_stop(struct nb_queue *queue)
+{
+	pthread_mutex_lock(&queue->lock);
+	queue->stop = true;
+	pthread_cond_broadcast(&queue->submit_cond);
+	pthread_mutex_unlock(&queue->lock);
+
+	for (size_t i = 0; i < queue->threads_count; i++) {
+		pthread_join(queue->threads[i], NULL);
+	}
+}
+
+static int
+nb_queue_create_pool(struct nb_queue *queue)
+{
+	int rc = 0;
+
+	rc--;
+	queue->submitted = calloc(queue->depth, sizeof(*queue->submitted));
+	if (queue->submitted == NULL) {
+		fprintf(stderr, "queue malloc failed\n");
+		goto error_1;
+	}
+
+	rc--;
+	queue->completed = calloc(queue->depth, sizeof(*queue->completed));
+	if (queue->completed == NULL) {
+		fprintf(stderr, "queue malloc failed\n");
+		goto error_2;
+	}
+
+	rc--;
+	queue->threads = calloc(queue->depth, sizeof(*queue->threads));
+	if (queue->threads == NULL) {
+		fprintf(stderr, "queue malloc failed\n");
+		goto error_3;
+	}
+
+	pthread_mutex_init(&queue->lock, NULL);
+	pthread_cond_init(&queue->submit_cond, NULL);
+	pthread_cond_init(&queue->complete_cond, NULL);
+
+	rc--;
+	for (; queue->threads_count < queue->depth; queue->threads_count++) {
+		if (pthread_create(&queue->threads[queue->threads_count], NULL,
+				   nb_queue_thread, queue) != 0) {
+			fprintf(stderr, "pthread_create failed\n");
+			goto error_4;
+		}
+	}
+
+	return 0;
+
+error_4:
+	nb_queue_stop(queue);
+	pthread_cond_destroy(&queue->complete_cond);
+	pthread_cond_destroy(&queue->submit_cond);
+	pthread_mutex_destroy(&queue->lock);
+	free(queue->threads);
+error_3:
+	free(queue->completed);
+error_2:
+	free(queue->submitted);
+error_1:
+	return rc;
+}
+
+struct nb_queue *
+nb_queue_new(const struct nb_db_if *pif, struct nb_db *db, size_t depth)
+{
+	struct nb_queue *queue = calloc(1, sizeof(*queue));
+	if (queue == NULL) {
+		fprintf(stderr, "queue malloc failed\n");
+		return NULL;
+	}
+
+	queue->pif = pif;
+	queue->db = db;
+	queue->depth = depth;
+
+	if (nb_queue_is_native(pif)) {
+		queue->native = pif->queue_open(db, depth);
+		if (queue->native == NULL) {
+			fprintf(stderr, "driver::queue_open failed\n");
+			free(queue);
+			return NULL;
+		}
+		return queue;
+	}
+
+	if (nb_queue_create_pool(queue) != 0) {
+		free(queue);
+		return NULL;
+	}
+
+	return queue;
+}
+
+void
+nb_queue_delete(struct nb_queue *queue)
+{
+	if (queue->native != NULL) {
+		queue->pif->queue_close(queue->native);
+		free(queue);
+		return;
+	}
+
+	nb_queue_stop(queue);
+	pthread_cond_destroy(&queue->complete_cond);
+	pthread_cond_destroy(&queue->submit_cond);
+	pthread_mutex_destroy(&queue->lock);
+	free(queue->threads);
+	free(queue->completed);
+	free(queue->submitted);
+	free(queue);
+}
+
+int
+nb_queue_submit(struct nb_queue *queue, struct nb_db_req *req)
+{
+	if (queue->native != NULL)
+		return queue->pif->queue_submit(queue->native, req);
+
+	/* Both rings are sized for `depth` outstanding requests */
+	if (queue->pending >= queue->depth)
+		return -1;
+
+	pthread_mutex_lock(&queue->lock);
+	size_t tail = (queue->submitted_head + queue->submitted_count) %
+		      queue->depth;
+	queue->submitted[tail] = req;
+	queue->submitted_count++;
+	pthread_cond_signal(&queue->submit_cond);
+	pthread_mutex_unlock(&queue->lock);
+	queue->pending++;
+
+	return 0;
+}
+
+size_t
+nb_queue_poll(struct nb_queue *queue, struct nb_db_req **reqs, size_t count)
+{
+	if (queue->native != NULL)
+		return queue->pif->queue_poll(queue->native, reqs, count);
+
+	if (queue->pending == 0 || count == 0)
+		return 0;
+
+	pthread_mutex_lock(&queue->lock);
+	while (queue->completed_count == 0)
+		pthread_cond_wait(&queue->complete_cond, &queue->lock);
+
+	size_t n = 0;
+	for (; n < count && queue->completed_count > 0; n++) {
+		reqs[n] = queue->completed[queue->completed_head];
+		queue->completed_head = (queue->completed_head + 1) %
+					queue->depth;
+		queue->completed_count--;
+	}
+	pthread_mutex_unlock(&queue->lock);
+	queue->pending -= n;
+
+	return n;
+}
@@ -0,0 +1,65 @@
+#ifndef NB_QUEUE_H_INCLUDED
+#define NB_QUEUE_H_INCLUDED
+
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "nb_plugin_api.h"
+
+/*
+ * Queue of asynchronous requests. Uses the native queue of the driver if
+ * it has one, otherwise requests are executed synchronously by a pool of
+ * `depth` threads, so every outstanding request has a thread to run on.
+ */
+struct nb_queue;
+
+struct nb_queue *
+nb_queue_new(const struct nb_db_if *pif, struct nb_db *db, size_t depth);
+
+void
+nb_queue_delete(struct nb_queue *queue);
+
+/* Returns true if the driver can run requests asynchronously by itself */
+bool
+nb_queue_is_native(const struct nb_db_if *pif);
+
+int
+nb_queue_submit(struct nb_queue *queue, struct nb_db_req *req);
+
+/*
+ * Wait for at least one completed request.
+ * Returns the number of requests stored to `reqs`.
+ */
+size_t
+nb_queue_poll(struct nb_queue *queue, struct nb_db_req **reqs, size_t count);
+
+#endif /* NB_QUEUE_H_INCLUDED */
@@ -30,7 +30,12 @@
 #include "nb_random.h"
 
 #include <stdbool.h>
+#include <stdatomic.h>
 #include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
 #include <sys/time.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
@@ -39,6 +44,21 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+const char *nb_random_type_names[NB_RANDOM_MAX] = {
+	"sequential",
+	"uniform",
+	"zipfian",
+	"latest",
+	"hotspot",
+};
+
+const char *nb_key_format_names[NB_KEY_MAX] = {
+	"file",
+	"binary",
+	"int",
+	"ascii",
+};
+
 static int
 nb_random_open_file(struct nb_random *rnd, const char *filename, bool rw)
 {
@@ -71,6 +91,7 @@ nb_random_open_file(struct nb_random *rnd, const char *filename, bool rw)
 
 	rnd->fd = fd;
 	rnd->map = map;
+	rnd->size = file_stat.st_size;
 	rnd->cur = 0;
 	rnd->end = file_stat.st_size;
 
@@ -89,7 +110,7 @@ nb_random_close_file(struct nb_random *random)
 	int r;
 
 	rc--;
-	r = munmap(random->map, random->end);
+	r = munmap(random->map, random->size);
 	if (r != 0) {
 		perror("munmap");
 		goto error_2;
@@ -121,7 +142,7 @@ nb_random_create(struct nb_random *random, const char *filename)
 		goto error_1;
 
 	rc--;
-	r = posix_madvise(random->map, random->end, POSIX_MADV_SEQUENTIAL);
+	r = posix_madvise(random->map, random->size, POSIX_MADV_SEQUENTIAL);
 	if (r != 0) {
 		perror("madvise");
 		goto error_2;
@@ -135,26 +156,689 @@ error_1:
 	return rc;
 }
 
+int
+nb_random_create_generated(struct nb_random *random,
+			   enum nb_key_format format, uint64_t seed)
+{
+	memset(random, 0, sizeof(*random));
+
+	random->fd = -1;
+	random->format = format;
+	random->key_seed = nb_random_u64(&seed);
+	random->size = SIZE_MAX;
+	random->end = SIZE_MAX;
+
+	return 0;
+}
+
+uint64_t
+nb_random_generated_max(enum nb_key_format format, size_t key_size)
+{
+	uint64_t max = 1;
+	size_t digits = 0;
+
+	switch (format) {
+	case NB_KEY_BINARY:
+		/* Truncated words of a bijection are not unique */
+		return key_size < 8 ? 0 : UINT64_MAX;
+	case NB_KEY_INT:
+		return key_size < 8 ? (1ULL << (key_size * 8)) : UINT64_MAX;
+	case NB_KEY_ASCII:
+		for (; digits < key_size && digits < 19; digits++)
+			max *= 10;
+		return key_size <= 19 ? max : UINT64_MAX;
+	default:
+		return 0;
+	}
+}
+
+/* The SplitMix64 finalizer, a bijection of 64-bit words */
+static inline uint64_t
+nb_random_mix(uint64_t z)
+{
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+uint64_t
+nb_random_hash(const void *data, size_t len, uint64_t seed)
+{
+	const char *p = (const char *) data;
+	uint64_t h = nb_random_mix(seed ^ len);
+
+	for (; len >= 8; len -= 8, p += 8) {
+		uint64_t word;
+		memcpy(&word, p, 8);
+		h = nb_random_mix(h ^ word) + 0x9e3779b97f4a7c15ULL;
+	}
+	if (len > 0) {
+		uint64_t word = 0;
+		memcpy(&word, p, len);
+		h = nb_random_mix(h ^ word);
+	}
+
+	return nb_random_mix(h);
+}
+
+static void
+nb_random_generate(const struct nb_random *random, uint64_t i,
+		   char *key, size_t key_size)
+{
+	switch (random->format) {
+	case NB_KEY_BINARY: {
+		uint64_t word = nb_random_mix(i ^ random->key_seed);
+		for (size_t off = 0; off < key_size; off += 8) {
+			size_t n = key_size - off < 8 ? key_size - off : 8;
+			memcpy(key + off, &word, n);
+			word = nb_random_mix(word + 0x9e3779b97f4a7c15ULL);
+		}
+		break;
+	}
+	case NB_KEY_INT:
+		for (size_t b = key_size; b > 0; b--) {
+			key[b - 1] = (char) (i & 0xff);
+			i >>= 8;
+		}
+		break;
+	case NB_KEY_ASCII:
+		for (size_t b = key_size; b > 0; b--) {
+			key[b - 1] = (char) ('0' + i % 10);
+			i /= 10;
+		}
+		break;
+	default:
+		break;
+	}
+}
+
 void
 nb_random_destroy(struct nb_random *random)
 {
+	if (random->format != NB_KEY_FILE)
+		return;
 	nb_random_close_file(random);
 }
 
 int
-nb_random_next(struct nb_random *random, char *key, size_t key_size)
+nb_random_slice(struct nb_random *random, size_t offset, size_t size)
 {
-	if (random->cur + key_size >= random->end)
+	if (offset > random->size || size > random->size - offset)
+		return -1;
+
+	random->cur = offset;
+	random->end = offset + size;
+
+	return 0;
+}
+
+/*
+ * Zipfian generator from "Quickly Generating Billion-Record Synthetic
+ * Databases" by J. Gray et al., as used by YCSB. Returns [0, items).
+ */
+static size_t
+nb_random_zipfian(const struct nb_random_dist *dist, uint64_t *rng)
+{
+	double u = nb_random_double(rng);
+	double uz = u * dist->zetan;
+	if (uz < 1.0)
+		return 0;
+	if (uz < 1.0 + pow(0.5, dist->theta))
 		return 1;
 
-	memcpy(key, (char *) random->map + random->cur, key_size);
+	size_t i = (size_t) (dist->items *
+			     pow(dist->eta * u - dist->eta + 1.0, dist->alpha));
+	return i < dist->items ? i : dist->items - 1;
+}
+
+/* FNV-1a of the index, spreads popular items over the key space */
+static inline uint64_t
+nb_random_scramble(uint64_t val)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (int i = 0; i < 8; i++) {
+		hash ^= val & 0xff;
+		hash *= 0x100000001b3ULL;
+		val >>= 8;
+	}
+	return hash;
+}
+
+size_t
+nb_random_dist_next(const struct nb_random_dist *dist, uint64_t *rng)
+{
+	size_t items = dist->items;
+
+	switch (dist->type) {
+	case NB_RANDOM_UNIFORM:
+		return (size_t) (nb_random_double(rng) * items);
+	case NB_RANDOM_ZIPFIAN:
+		return nb_random_scramble(nb_random_zipfian(dist, rng)) % items;
+	case NB_RANDOM_LATEST:
+		return items - 1 - nb_random_zipfian(dist, rng);
+	case NB_RANDOM_HOTSPOT: {
+		size_t hot = (size_t) (dist->hot_keys * items);
+		if (hot == 0)
+			hot = 1;
+		if (nb_random_double(rng) < dist->hot_ops || hot == items)
+			return (size_t) (nb_random_double(rng) * hot);
+		return hot + (size_t) (nb_random_double(rng) * (items - hot));
+	}
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Sum of 1 / i^theta for i in [1, n]. The first terms are added exactly,
+ * the tail is taken by Euler-Maclaurin, which is exact to double precision
+ * that far out, so startup doesn't grow with the number of keys.
+ */
+enum { NB_RANDOM_ZETA_EXACT = 65536 };
+
+static double
+nb_random_zeta(size_t n, double theta)
+{
+	size_t exact = n < NB_RANDOM_ZETA_EXACT ? n : NB_RANDOM_ZETA_EXACT;
+	double zeta = 0.0;
+	for (size_t i = 1; i <= exact; i++)
+		zeta += 1.0 / pow(i, theta);
+	if (n == exact)
+		return zeta;
+
+	double a = (double) exact;
+	double b = (double) n;
+	double s = theta;
+	/* f(x) = x^-s, the sum over (a, b] */
+	zeta += (pow(b, 1.0 - s) - pow(a, 1.0 - s)) / (1.0 - s);
+	zeta += (pow(b, -s) - pow(a, -s)) / 2.0;
+	zeta += -s * (pow(b, -s - 1.0) - pow(a, -s - 1.0)) / 12.0;
+	zeta -= -s * (s + 1.0) * (s + 2.0) *
+		(pow(b, -s - 3.0) - pow(a, -s - 3.0)) / 720.0;
+	return zeta;
+}
+
+int
+nb_random_dist_init(struct nb_random_dist *dist, size_t items)
+{
+	if (items == 0) {
+		fprintf(stderr, "Key distribution needs at least one key\n");
+		return -1;
+	}
+	dist->items = items;
+
+	if (dist->type == NB_RANDOM_HOTSPOT &&
+	    (dist->hot_keys <= 0.0 || dist->hot_keys > 1.0 ||
+	     dist->hot_ops < 0.0 || dist->hot_ops > 1.0)) {
+		fprintf(stderr, "Hot keys must be in (0, 1], hot ops in "
+			"[0, 1]\n");
+		return -1;
+	}
+
+	if (dist->type != NB_RANDOM_ZIPFIAN && dist->type != NB_RANDOM_LATEST)
+		return 0;
+
+	if (dist->theta <= 0.0 || dist->theta >= 1.0) {
+		fprintf(stderr, "Zipfian theta must be in (0, 1): %lf\n",
+			dist->theta);
+		return -1;
+	}
+
+	double zetan = nb_random_zeta(items, dist->theta);
+	double zeta2 = 1.0 + 1.0 / pow(2, dist->theta);
+
+	dist->zetan = zetan;
+	dist->alpha = 1.0 / (1.0 - dist->theta);
+	dist->eta = (1.0 - pow(2.0 / items, 1.0 - dist->theta)) /
+		    (1.0 - zeta2 / zetan);
+
+	return 0;
+}
+
+const char *nb_size_type_names[NB_SIZE_MAX] = {
+	"fixed",
+	"uniform",
+	"zipfian",
+	"empirical",
+};
+
+static int
+nb_random_sizes_load(struct nb_random_sizes *sizes)
+{
+	FILE *file = fopen(sizes->filename, "r");
+	if (file == NULL) {
+		perror(sizes->filename);
+		return -1;
+	}
+
+	size_t capacity = 0;
+	double total = 0.0;
+	char line[256];
+	int rc = -1;
+	while (fgets(line, sizeof(line), file) != NULL) {
+		unsigned long long size;
+		double weight = 1.0;
+		if (line[0] == '#' || line[strspn(line, " \t\r\n")] == 0)
+			continue;
+		if (sscanf(line, "%llu %lf", &size, &weight) < 1 ||
+		    weight < 0.0) {
+			fprintf(stderr, "Invalid line in %s: %s",
+				sizes->filename, line);
+			goto out;
+		}
+
+		if (sizes->count == capacity) {
+			capacity = capacity > 0 ? capacity * 2 : 16;
+			size_t *arr = realloc(sizes->sizes,
+					      capacity * sizeof(*arr));
+			if (arr != NULL)
+				sizes->sizes = arr;
+			double *cdf = realloc(sizes->cdf,
+					      capacity * sizeof(*cdf));
+			if (cdf != NULL)
+				sizes->cdf = cdf;
+			if (arr == NULL || cdf == NULL) {
+				fprintf(stderr, "sizes malloc failed\n");
+				goto out;
+			}
+		}
+
+		total += weight;
+		sizes->sizes[sizes->count] = (size_t) size;
+		sizes->cdf[sizes->count] = total;
+		sizes->count++;
+
+		if (sizes->count == 1 || size < sizes->min)
+			sizes->min = (size_t) size;
+		if (sizes->count == 1 || size > sizes->max)
+			sizes->max = (size_t) size;
+	}
+
+	if (sizes->count == 0 || total <= 0.0) {
+		fprintf(stderr, "No %s sizes in %s\n", sizes->name,
+			sizes->filename);
+		goto out;
+	}
+
+	for (size_t i = 0; i < sizes->count; i++)
+		sizes->cdf[i] /= total;
+	sizes->cdf[sizes->count - 1] = 1.0;
+	rc = 0;
+
+out:
+	fclose(file);
+	return rc;
+}
+
+int
+nb_random_sizes_create(struct nb_random_sizes *sizes)
+{
+	sizes->sizes = NULL;
+	sizes->cdf = NULL;
+	sizes->count = 0;
+
+	if (sizes->type == NB_SIZE_EMPIRICAL &&
+	    nb_random_sizes_load(sizes) != 0)
+		goto error;
+
+	if (sizes->type == NB_SIZE_FIXED)
+		sizes->min = sizes->max;
+	if (sizes->min > sizes->max || sizes->max == 0) {
+		fprintf(stderr, "Invalid %s sizes: [%zu, %zu]\n",
+			sizes->name, sizes->min, sizes->max);
+		goto error;
+	}
+
+	if (sizes->type == NB_SIZE_ZIPFIAN) {
+		/* latest: the first items are the most popular */
+		sizes->zipf.type = NB_RANDOM_LATEST;
+		sizes->zipf.theta = sizes->theta;
+		if (nb_random_dist_init(&sizes->zipf,
+					sizes->max - sizes->min + 1) != 0)
+			goto error;
+	}
+
+	return 0;
+
+error:
+	nb_random_sizes_destroy(sizes);
+	return -1;
+}
+
+void
+nb_random_sizes_destroy(struct nb_random_sizes *sizes)
+{
+	free(sizes->cdf);
+	free(sizes->sizes);
+	sizes->cdf = NULL;
+	sizes->sizes = NULL;
+}
+
+size_t
+nb_random_sizes_next(const struct nb_random_sizes *sizes, uint64_t *rng)
+{
+	switch (sizes->type) {
+	case NB_SIZE_UNIFORM:
+		return sizes->min + (size_t) (nb_random_double(rng) *
+					      (sizes->max - sizes->min + 1));
+	case NB_SIZE_ZIPFIAN:
+		return sizes->max - nb_random_dist_next(&sizes->zipf, rng);
+	case NB_SIZE_EMPIRICAL: {
+		double u = nb_random_double(rng);
+		size_t begin = 0;
+		size_t end = sizes->count - 1;
+		while (begin < end) {
+			size_t mid = begin + (end - begin) / 2;
+			if (sizes->cdf[mid] <= u)
+				begin = mid + 1;
+			else
+				end = mid;
+		}
+		return sizes->sizes[begin];
+	}
+	default:
+		return sizes->max;
+	}
+}
+
+void
+nb_random_set_key_sizes(struct nb_random *random,
+			const struct nb_random_sizes *sizes, uint64_t seed)
+{
+	random->key_sizes = sizes;
+	random->key_sizes_seed = nb_random_mix(seed ^ 0x6b65796c656eULL);
+}
+
+/* The length of key i, the same in every run with the same seed */
+static inline size_t
+nb_random_key_len(const struct nb_random *random, size_t i, size_t key_size)
+{
+	if (random->key_sizes == NULL)
+		return key_size;
+
+	uint64_t rng = random->key_sizes_seed ^ nb_random_mix(i);
+	return nb_random_sizes_next(random->key_sizes, &rng);
+}
+
+int
+nb_random_set_dist(struct nb_random *random,
+		   const struct nb_random_dist *dist,
+		   size_t key_size, uint64_t seed)
+{
+	if (dist->items > random->size / key_size)
+		return -1;
+
+	random->dist = dist;
+	random->rng = seed;
+
+	/* Records are read at random, read-ahead is useless */
+	if (random->format == NB_KEY_FILE)
+		posix_madvise(random->map, random->size, POSIX_MADV_RANDOM);
+
+	return 0;
+}
+
+/*
+ * Balanced Feistel network over the smallest even number of bits that
+ * covers [0, perm_items). Values outside of the range are encrypted again
+ * (cycle walking), so the result is a bijection of [0, perm_items).
+ */
+static size_t
+nb_random_permute(const struct nb_random *random, size_t i)
+{
+	int half = random->perm_half_bits;
+	uint64_t mask = (1ULL << half) - 1;
+	uint64_t x = i;
+
+	do {
+		uint64_t left = x >> half;
+		uint64_t right = x & mask;
+		for (int round = 0; round < NB_RANDOM_FEISTEL_ROUNDS; round++) {
+			uint64_t f = nb_random_mix(right ^
+						   random->perm_keys[round]);
+			uint64_t next = left ^ (f & mask);
+			left = right;
+			right = next;
+		}
+		x = (left << half) | right;
+	} while (x >= random->perm_items);
+
+	return (size_t) x;
+}
+
+int
+nb_random_set_permutation(struct nb_random *random, size_t items,
+			  size_t key_size, uint64_t seed)
+{
+	if (items == 0 || items > random->size / key_size)
+		return -1;
+
+	int half = 1;
+	while (half < 32 && (items - 1) >> (2 * half) != 0)
+		half++;
+
+	random->perm_items = items;
+	random->perm_half_bits = half;
+	for (int round = 0; round < NB_RANDOM_FEISTEL_ROUNDS; round++)
+		random->perm_keys[round] = nb_random_u64(&seed);
+
+	/* Records are read at random, read-ahead is useless */
+	if (random->format == NB_KEY_FILE)
+		posix_madvise(random->map, random->size, POSIX_MADV_RANDOM);
+
+	return 0;
+}
+
+static void
+nb_random_read(const struct nb_random *random, size_t i, char *key,
+	       size_t key_size, size_t *key_len)
+{
+	*key_len = nb_random_key_len(random, i, key_size);
+
+	if (random->format != NB_KEY_FILE)
+		nb_random_generate(random, i, key, *key_len);
+	else
+		memcpy(key, (char *) random->map + i * key_size, *key_len);
+}
+
+int
+nb_random_next(struct nb_random *random, char *key, size_t key_size,
+	       size_t *key_len)
+{
+	if (random->dist != NULL) {
+		size_t i = nb_random_dist_next(random->dist, &random->rng);
+		nb_random_read(random, i, key, key_size, key_len);
+		return 0;
+	}
+
+	if (random->cur + key_size > random->end)
+		return 1;
+
+	size_t i = random->cur / key_size;
 	random->cur += key_size;
+	if (random->perm_items > 0)
+		i = nb_random_permute(random, i);
+
+	nb_random_read(random, i, key, key_size, key_len);
+
+	return 0;
+}
+
+/*
+ * Parallel shuffle: every record is scattered to a random bucket of a new
+ * file, then every bucket is shuffled in place with Fisher-Yates. Buckets
+ * are small enough to stay in cache, and the scatter writes every bucket
+ * sequentially. Records are split into fixed chunks with their own PRNG
+ * streams, so the result depends on the seed but not on the thread count.
+ * Chunks are sized by the number of records only: up to 256 of them keep
+ * threads busy unless chunks would be too small to pay off.
+ */
+enum {
+	NB_SHUFFLE_BUCKET_SIZE = 2 * 1024 * 1024,
+	NB_SHUFFLE_CHUNK_MIN = 4096,
+	NB_SHUFFLE_CHUNKS_MAX = 256
+};
+
+struct nb_shuffle {
+	const char *src;
+	char *dst;
+	size_t bs;
+	size_t n;
+	uint64_t seed;
+	size_t chunk;
+	size_t chunks;
+	size_t buckets;
+	/* records of chunk c in bucket b, then their offsets in dst */
+	size_t *counts;
+	int pass;
+	atomic_size_t next;
+	atomic_size_t done;
+};
+
+/* Unbiased random number in [0, n), see D. Lemire, arXiv:1805.10941 */
+static inline uint64_t
+nb_random_bounded(uint64_t *rng, uint64_t n)
+{
+	__uint128_t m = (__uint128_t) nb_random_u64(rng) * n;
+	if ((uint64_t) m < n) {
+		uint64_t t = -n % n;
+		while ((uint64_t) m < t)
+			m = (__uint128_t) nb_random_u64(rng) * n;
+	}
+	return (uint64_t) (m >> 64);
+}
 
+static void
+nb_shuffle_chunk(struct nb_shuffle *sh, size_t c)
+{
+	size_t begin = c * sh->chunk;
+	size_t end = begin + sh->chunk < sh->n ? begin + sh->chunk : sh->n;
+	size_t *counts = sh->counts + c * sh->buckets;
+	uint64_t rng = sh->seed ^ nb_random_mix(c);
+
+	for (size_t i = begin; i < end; i++) {
+		size_t b = nb_random_bounded(&rng, sh->buckets);
+		if (sh->pass == 0) {
+			counts[b]++;
+			continue;
+		}
+		memcpy(sh->dst + counts[b]++ * sh->bs,
+		       sh->src + i * sh->bs, sh->bs);
+	}
+	atomic_fetch_add(&sh->done, end - begin);
+}
+
+static void
+nb_shuffle_bucket(struct nb_shuffle *sh, size_t b)
+{
+	size_t last = sh->counts[(sh->chunks - 1) * sh->buckets + b];
+	size_t first = (b > 0) ?
+		sh->counts[(sh->chunks - 1) * sh->buckets + b - 1] : 0;
+	size_t n = last - first;
+	char *base = sh->dst + first * sh->bs;
+	uint64_t rng = sh->seed ^ nb_random_mix(~(uint64_t) b);
+
+	char buf[256];
+	for (size_t i = n; i > 1; i--) {
+		size_t j = nb_random_bounded(&rng, i);
+		char *a = base + (i - 1) * sh->bs;
+		char *c = base + j * sh->bs;
+		for (size_t off = 0; off < sh->bs; off += sizeof(buf)) {
+			size_t len = sh->bs - off < sizeof(buf) ?
+				     sh->bs - off : sizeof(buf);
+			memcpy(buf, a + off, len);
+			memcpy(a + off, c + off, len);
+			memcpy(c + off, buf, len);
+		}
+	}
+	atomic_fetch_add(&sh->done, n);
+}
+
+static void *
+nb_shuffle_thread(void *arg)
+{
+	struct nb_shuffle *sh = (struct nb_shuffle *) arg;
+	size_t tasks = sh->pass < 2 ? sh->chunks : sh->buckets;
+
+	while (true) {
+		size_t task = atomic_fetch_add(&sh->next, 1);
+		if (task >= tasks)
+			break;
+		if (sh->pass < 2)
+			nb_shuffle_chunk(sh, task);
+		else
+			nb_shuffle_bucket(sh, task);
+	}
+
+	return NULL;
+}
+
+/* Turn record counts into offsets of (chunk, bucket) in dst */
+static void
+nb_shuffle_offsets(struct nb_shuffle *sh)
+{
+	size_t offset = 0;
+	for (size_t b = 0; b < sh->buckets; b++) {
+		for (size_t c = 0; c < sh->chunks; c++) {
+			size_t count = sh->counts[c * sh->buckets + b];
+			sh->counts[c * sh->buckets + b] = offset;
+			offset += count;
+		}
+	}
+}
+
+static int
+nb_shuffle_run(struct nb_shuffle *sh, size_t threads)
+{
+	static const char *passes[] = { "counting", "scattering",
+					"shuffling" };
+	const struct timespec period = { 0, 100 * 1000 * 1000 };
+
+	pthread_t *tids = calloc(threads, sizeof(*tids));
+	if (tids == NULL) {
+		perror("malloc failed");
+		return -1;
+	}
+
+	for (sh->pass = 0; sh->pass < 3; sh->pass++) {
+		atomic_store(&sh->next, 0);
+		atomic_store(&sh->done, 0);
+
+		size_t started = 0;
+		for (; started < threads; started++) {
+			if (pthread_create(&tids[started], NULL,
+					   nb_shuffle_thread, sh) != 0)
+				break;
+		}
+		if (started == 0) {
+			fprintf(stderr, "pthread_create failed\n");
+			free(tids);
+			return -1;
+		}
+
+		while (atomic_load(&sh->done) < sh->n) {
+			fprintf(stderr, "\rShuffling file... %s %3.0lf%%",
+				passes[sh->pass],
+				1e2 * atomic_load(&sh->done) / sh->n);
+			nanosleep(&period, NULL);
+		}
+
+		for (size_t t = 0; t < started; t++)
+			pthread_join(tids[t], NULL);
+
+		fprintf(stderr, "\rShuffling file... %s %3.0lf%%",
+			passes[sh->pass], 1e2);
+		if (sh->pass == 0)
+			nb_shuffle_offsets(sh);
+	}
+
+	free(tids);
 	return 0;
 }
 
 int
-nb_random_shuffle(const char *filename, size_t bs, size_t count)
+nb_random_shuffle(const char *filename, size_t bs, size_t count,
+		  uint64_t seed, size_t threads)
 {
 	struct nb_random random;
 	memset(&random, 0, sizeof(random));
@@ -163,12 +847,12 @@ nb_random_shuffle(const char *filename, size_t bs, size_t count)
 	int r;
 
 	rc--;
-	r = nb_random_open_file(&random, filename, true);
+	r = nb_random_open_file(&random, filename, false);
 	if (r != 0) {
 		goto error_1;
 	}
 
-	size_t n = random.end / bs;
+	size_t n = random.size / bs;
 
 	if (n == 0) {
 		goto skip;
@@ -178,29 +862,82 @@ nb_random_shuffle(const char *filename, size_t bs, size_t count)
 		n = count;
 	}
 
+	struct nb_shuffle sh;
+	memset(&sh, 0, sizeof(sh));
+	sh.src = random.map;
+	sh.bs = bs;
+	sh.n = n;
+	sh.seed = nb_random_mix(seed);
+	sh.buckets = (n * bs + NB_SHUFFLE_BUCKET_SIZE - 1) /
+		     NB_SHUFFLE_BUCKET_SIZE;
+	sh.chunk = (n + NB_SHUFFLE_CHUNKS_MAX - 1) / NB_SHUFFLE_CHUNKS_MAX;
+	if (sh.chunk < NB_SHUFFLE_CHUNK_MIN)
+		sh.chunk = NB_SHUFFLE_CHUNK_MIN;
+	sh.chunks = (n + sh.chunk - 1) / sh.chunk;
+
 	rc--;
-	char *buf = malloc(bs);
-	if (buf == NULL) {
+	sh.counts = calloc(sh.chunks * sh.buckets, sizeof(*sh.counts));
+	if (sh.counts == NULL) {
 		perror("malloc failed");
 		goto error_2;
 	}
 
-	for (size_t i = 0; i < n - 1; i++)
-	{
-		  size_t j = i + rand() / (RAND_MAX / (n - i) + 1);
-		  char *a = (char *) random.map + bs * i;
-		  char *b = (char *) random.map + bs * j;
+	/* The shuffled file is written next to the original */
+	rc--;
+	char tmpname[PATH_MAX];
+	snprintf(tmpname, sizeof(tmpname), "%s.shuffle", filename);
+	int fd = open(tmpname, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd == -1) {
+		perror("open");
+		goto error_3;
+	}
+
+	/* The shuffled file replaces the original, so it takes its mode */
+	rc--;
+	struct stat st;
+	if (fstat(random.fd, &st) != 0 ||
+	    fchmod(fd, st.st_mode & 07777) != 0) {
+		perror("fchmod");
+		goto error_4;
+	}
+
+	rc--;
+	if (ftruncate(fd, random.size) != 0) {
+		perror("ftruncate");
+		goto error_4;
+	}
 
-		  memcpy(buf, a, bs);
-		  memcpy(a, b, bs);
-		  memcpy(b, buf, bs);
+	rc--;
+	void *map = mmap(NULL, random.size, PROT_READ | PROT_WRITE,
+			 MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		perror("mmap failed");
+		goto error_4;
 	}
+	sh.dst = map;
+
+	/* Records beyond `count` are kept in place */
+	memcpy(sh.dst + n * bs, sh.src + n * bs, random.size - n * bs);
+
+	rc--;
+	if (nb_shuffle_run(&sh, threads > 0 ? threads : 1) != 0)
+		goto error_5;
 
-	free(buf);
 	rc--;
-	r = msync(random.map, random.end, MS_SYNC);
+	r = msync(map, random.size, MS_SYNC);
 	if (r != 0) {
 		perror("msync");
+		goto error_5;
+	}
+
+	munmap(map, random.size);
+	close(fd);
+	free(sh.counts);
+
+	rc--;
+	if (rename(tmpname, filename) != 0) {
+		perror("rename");
+		unlink(tmpname);
 		goto error_2;
 	}
 
@@ -212,6 +949,13 @@ skip:
 
 	return 0;
 
+error_5:
+	munmap(map, random.size);
+error_4:
+	close(fd);
+	unlink(tmpname);
+error_3:
+	free(sh.counts);
 error_2:
 	nb_random_close_file(&random);
 error_1:
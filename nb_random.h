@@ -31,24 +31,224 @@
  */
 
 #include <stddef.h>
+#include <stdint.h>
+
+/* Order in which records of the keys file are read */
+enum nb_random_type {
+	/* every record once, in file order */
+	NB_RANDOM_SEQUENTIAL,
+	/* records are chosen at random from a fixed set of records */
+	NB_RANDOM_UNIFORM,
+	/* scrambled zipfian: popular records are spread over the set */
+	NB_RANDOM_ZIPFIAN,
+	/* zipfian, the last records of the set are the most popular */
+	NB_RANDOM_LATEST,
+	/* hot_ops of ops go to the first hot_keys of records */
+	NB_RANDOM_HOTSPOT,
+	NB_RANDOM_MAX
+};
+
+extern const char *nb_random_type_names[NB_RANDOM_MAX];
+
+/* Source of keys: a keys file or key i derived from the seed */
+enum nb_key_format {
+	NB_KEY_FILE,
+	/* pseudo-random bytes, unique in the first 8 bytes */
+	NB_KEY_BINARY,
+	/* big-endian integer i */
+	NB_KEY_INT,
+	/* zero-padded decimal i */
+	NB_KEY_ASCII,
+	NB_KEY_MAX
+};
+
+extern const char *nb_key_format_names[NB_KEY_MAX];
+
+/*
+ * A key distribution over `items` records. Constants of the zipfian
+ * distribution take O(items) to compute, so they are shared by streams.
+ */
+struct nb_random_dist {
+	enum nb_random_type type;
+	size_t items;
+	double theta;
+	double hot_keys;
+	double hot_ops;
+	/* zipfian constants */
+	double zetan;
+	double alpha;
+	double eta;
+};
+
+/* Distribution of sizes of keys or values */
+enum nb_size_type {
+	/* always `max` bytes */
+	NB_SIZE_FIXED,
+	/* [min, max] bytes, uniformly */
+	NB_SIZE_UNIFORM,
+	/* [min, max] bytes, smaller sizes are more popular */
+	NB_SIZE_ZIPFIAN,
+	/* sizes and their weights are read from a file */
+	NB_SIZE_EMPIRICAL,
+	NB_SIZE_MAX
+};
+
+extern const char *nb_size_type_names[NB_SIZE_MAX];
+
+struct nb_random_sizes {
+	enum nb_size_type type;
+	size_t min;
+	size_t max;
+	double theta;
+	const char *filename;
+	/* "key" or "value", used in messages */
+	const char *name;
+
+	struct nb_random_dist zipf;
+	/* empirical sizes and cumulative probabilities */
+	size_t *sizes;
+	double *cdf;
+	size_t count;
+};
+
+enum { NB_RANDOM_FEISTEL_ROUNDS = 4 };
 
 struct nb_random {
 	int fd;
 	void *map;
+	/* offsets are in bytes of records even for generated keys */
+	size_t size;
 	size_t cur;
 	size_t end;
+	enum nb_key_format format;
+	uint64_t key_seed;
+	/* not NULL if the length of key i is drawn from sizes */
+	const struct nb_random_sizes *key_sizes;
+	uint64_t key_sizes_seed;
+	/* not NULL if records are chosen by a distribution */
+	const struct nb_random_dist *dist;
+	uint64_t rng;
+	/* records are read in a permuted order if perm_items > 0 */
+	size_t perm_items;
+	int perm_half_bits;
+	uint64_t perm_keys[NB_RANDOM_FEISTEL_ROUNDS];
 };
 
 int
 nb_random_create(struct nb_random *random, const char *filename);
 
+/*
+ * Generate keys instead of reading a file. Key i is a function of
+ * `seed` and i only, so runs with the same seed see the same keys.
+ */
+int
+nb_random_create_generated(struct nb_random *random,
+			   enum nb_key_format format, uint64_t seed);
+
+/* Number of distinct keys of `key_size` bytes the format can produce */
+uint64_t
+nb_random_generated_max(enum nb_key_format format, size_t key_size);
+
 void
 nb_random_destroy(struct nb_random *random);
 
+/*
+ * Restrict the stream to [offset, offset + size) bytes of the file.
+ * Used to give every benchmark thread its own non-overlapping set of keys.
+ */
 int
-nb_random_next(struct nb_random *random, char *key, size_t key_size);
+nb_random_slice(struct nb_random *random, size_t offset, size_t size);
 
+/*
+ * Read the next key into a buffer of `key_size` bytes. Records of the
+ * file are `key_size` bytes, `key_len` is the length of the key.
+ */
+int
+nb_random_next(struct nb_random *random, char *key, size_t key_size,
+	       size_t *key_len);
+
+/*
+ * Keys get a length from `sizes`, which is a function of the seed and
+ * the record number, so every run sees the same length of a key. Keys
+ * are prefixes of records of the file or of generated keys.
+ */
+void
+nb_random_set_key_sizes(struct nb_random *random,
+			const struct nb_random_sizes *sizes, uint64_t seed);
+
+/*
+ * Initialize a size distribution using the parameters set by the
+ * caller. For empirical sizes `min` and `max` are set from the file.
+ */
+int
+nb_random_sizes_create(struct nb_random_sizes *sizes);
+
+void
+nb_random_sizes_destroy(struct nb_random_sizes *sizes);
+
+size_t
+nb_random_sizes_next(const struct nb_random_sizes *sizes, uint64_t *rng);
+
+/*
+ * Read record perm(i) instead of record i, where perm is a bijection of
+ * [0, items) defined by the seed. Slices are applied to positions in the
+ * permuted order, so every record is still read once.
+ */
+int
+nb_random_set_permutation(struct nb_random *random, size_t items,
+			  size_t key_size, uint64_t seed);
+
+/*
+ * Initialize a distribution of `dist->type` over `items` records using
+ * theta and hot_* parameters set by the caller.
+ */
+int
+nb_random_dist_init(struct nb_random_dist *dist, size_t items);
+
+/* Draw a number of [0, dist->items) from the distribution */
+size_t
+nb_random_dist_next(const struct nb_random_dist *dist, uint64_t *rng);
+
+/*
+ * Choose records of [0, dist->items) by the distribution instead of
+ * reading the file in order. The stream never ends.
+ */
+int
+nb_random_set_dist(struct nb_random *random,
+		   const struct nb_random_dist *dist,
+		   size_t key_size, uint64_t seed);
+
+/*
+ * SplitMix64 - a fast seedable 64-bit PRNG with a single word of state.
+ */
+static inline uint64_t
+nb_random_u64(uint64_t *state)
+{
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/* A fast 64-bit hash of a short string, a word at a time */
+uint64_t
+nb_random_hash(const void *data, size_t len, uint64_t seed);
+
+/* Returns a uniformly distributed double in [0, 1) */
+static inline double
+nb_random_double(uint64_t *state)
+{
+	return (nb_random_u64(state) >> 11) * 0x1.0p-53;
+}
+
+/*
+ * Shuffle the first `count` records of `bs` bytes of the file using
+ * `threads` threads. The result depends only on the seed. The result is
+ * written to `<filename>.shuffle` that then replaces the file, so it needs
+ * free disk space for a copy of the file.
+ */
 int
-nb_random_shuffle(const char *filename, size_t bs, size_t count);
+nb_random_shuffle(const char *filename, size_t bs, size_t count,
+		  uint64_t seed, size_t threads);
 
 #endif /* NB_RANDOM_H_INCLUDED */
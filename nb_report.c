@@ -0,0 +1,638 @@
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "nb_report.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "nb_engine_int.h"
+#include "nb_histogram.h"
+
+static double percentiles[] = { 0.05, 0.50, 0.95, 0.96, 0.97, 0.98, 0.99,
+				 0.995, 0.999, 0.9995, 0.9999 };
+static const size_t percentiles_size =
+	sizeof(percentiles) / sizeof(percentiles[0]);
+
+static void
+nb_report_percentiles(const char *title, struct nb_histogram *hist,
+		      struct nb_histogram *hist_corrected)
+{
+	fprintf(stdout, "%s:\n", title);
+	fprintf(stdout, "%-10s  %15s  %15s\n", "",
+		"uncorrected", "corrected");
+	for (size_t i = 0; i < percentiles_size; i++) {
+		double p = percentiles[i];
+		fprintf(stdout, "%-2.4lf%%  %15.6lf  %15.6lf * 1e-6 sec/op\n",
+			p * 1e2, nb_histogram_percentile(hist, p),
+			nb_histogram_percentile(hist_corrected, p));
+	}
+}
+
+/* Counts of events per op of the measured phase, all threads */
+static void
+nb_report_perf(struct nb_engine *engine, size_t ops)
+{
+	struct nb_perf_counts total;
+	memset(&total, 0, sizeof(total));
+	for (size_t i = 0; i < engine->workers_count; i++) {
+		struct nb_worker *w = &engine->workers[i];
+		for (int e = 0; e < NB_PERF_MAX; e++) {
+			total.value[e] += w->perf_stop.value[e] -
+					  w->perf_start.value[e];
+		}
+	}
+
+	fprintf(stdout, "Perf counters (per op):\n");
+	for (int e = 0; e < NB_PERF_MAX; e++) {
+		fprintf(stdout, "%-18s: ", nb_perf_event_names[e]);
+		if (!engine->perf_supported[e]) {
+			fprintf(stdout, "not supported\n");
+			continue;
+		}
+		fprintf(stdout, "%11.1lf",
+			ops > 0 ? (double) total.value[e] / ops : 0.0);
+		if (e == NB_PERF_INSTRUCTIONS &&
+		    engine->perf_supported[NB_PERF_CYCLES] &&
+		    total.value[NB_PERF_CYCLES] > 0) {
+			fprintf(stdout, " (%.2lf per cycle)",
+				(double) total.value[e] /
+				total.value[NB_PERF_CYCLES]);
+		}
+		fprintf(stdout, "\n");
+	}
+}
+
+/*
+ * Amplification of the whole run including the warm-up: /proc/self/io
+ * can't tell phases of threads apart.
+ */
+static void
+nb_report_io(struct nb_engine *engine, struct nb_stats *stats)
+{
+	const struct nb_io *begin = &engine->io_begin;
+	const struct nb_io *end = &engine->io_end;
+
+	uint64_t logical = 0;
+	for (int op = 0; op < NB_OP_MAX; op++)
+		logical += stats->bytes[op];
+	size_t written = nb_stats_count(stats, NB_OP_PUT) +
+			 stats->records[NB_OP_BATCH];
+	size_t gets = nb_stats_count(stats, NB_OP_GET);
+	for (size_t i = 0; i < engine->workers_count; i++) {
+		struct nb_stats *warmup = &engine->workers[i].warmup;
+		for (int op = 0; op < NB_OP_MAX; op++)
+			logical += warmup->bytes[op];
+		written += nb_stats_count(warmup, NB_OP_PUT) +
+			   warmup->records[NB_OP_BATCH];
+		gets += nb_stats_count(warmup, NB_OP_GET);
+	}
+
+	uint64_t device_writes = nb_io_device_writes(end) -
+				 nb_io_device_writes(begin);
+	uint64_t device_reads = end->read_bytes - begin->read_bytes;
+	size_t count = engine->opts->count;
+
+	fprintf(stdout, "I/O:\n");
+	fprintf(stdout, "Logical writes    : %11llu bytes of keys and "
+		"values\n", (unsigned long long) logical);
+	fprintf(stdout, "Device writes     : %11llu bytes\n",
+		(unsigned long long) device_writes);
+	fprintf(stdout, "Device reads      : %11llu bytes\n",
+		(unsigned long long) device_reads);
+	fprintf(stdout, "Write syscalls    : %11llu (%llu bytes)\n",
+		(unsigned long long) (end->syscw - begin->syscw),
+		(unsigned long long) (end->wchar - begin->wchar));
+	fprintf(stdout, "Read syscalls     : %11llu (%llu bytes)\n",
+		(unsigned long long) (end->syscr - begin->syscr),
+		(unsigned long long) (end->rchar - begin->rchar));
+	fprintf(stdout, "Disk size         : %11llu bytes (%llu before)\n",
+		(unsigned long long) end->disk_size,
+		(unsigned long long) begin->disk_size);
+	if (logical > 0) {
+		fprintf(stdout, "Write amp         : %11.2lf\n",
+			(double) device_writes / logical);
+	}
+	if (gets > 0) {
+		fprintf(stdout, "Read amp          : %11.1lf device bytes "
+			"per get\n", (double) device_reads / gets);
+	}
+	/* The loaded set is --count records of the size written this run */
+	if (written > 0 && count > 0) {
+		double live = (double) logical / written * count;
+		fprintf(stdout, "Space amp         : %11.2lf\n",
+			end->disk_size / live);
+	}
+	if (count > 0) {
+		fprintf(stdout, "Disk per key      : %11.1lf bytes\n",
+			(double) end->disk_size / count);
+	}
+}
+
+static void
+nb_report_memory(struct nb_engine *engine)
+{
+	const struct nb_mem *begin = &engine->mem_begin;
+	const struct nb_mem *end = &engine->mem_end;
+	const double mb = 1024.0 * 1024.0;
+
+	fprintf(stdout, "Memory:\n");
+	fprintf(stdout, "RSS               : %11.1lf MB (%.1lf MB before "
+		"the database was opened)\n", end->rss / mb, begin->rss / mb);
+	fprintf(stdout, "Peak RSS          : %11.1lf MB\n",
+		end->rss_peak / mb);
+	fprintf(stdout, "Anonymous RSS     : %11.1lf MB\n",
+		end->rss_anon / mb);
+	fprintf(stdout, "File-backed RSS   : %11.1lf MB\n",
+		end->rss_file / mb);
+	if (end->pss > 0) {
+		fprintf(stdout, "PSS               : %11.1lf MB\n",
+			end->pss / mb);
+	}
+	fprintf(stdout, "Minor faults      : %11llu\n",
+		(unsigned long long) (end->minflt - begin->minflt));
+	fprintf(stdout, "Major faults      : %11llu\n",
+		(unsigned long long) (end->majflt - begin->majflt));
+	fprintf(stdout, "Harness           : %11.1lf MB of buffers, "
+		"histograms and mapped keys\n", engine->mem_harness / mb);
+	uint64_t baseline = begin->rss + engine->mem_harness;
+	if (engine->opts->count > 0 && end->rss > baseline) {
+		fprintf(stdout, "Memory per key    : %11.1lf bytes of RSS "
+			"growth less the harness\n",
+			(double) (end->rss - baseline) / engine->opts->count);
+	}
+}
+
+/* Per-record statistics for ops that process several records at once */
+static void
+nb_report_records(struct nb_stats *stats, enum nb_op op, const char *title)
+{
+	size_t ops = nb_stats_count(stats, op);
+	if (ops == 0)
+		return;
+
+	size_t records = stats->records[op];
+	double time = stats->time[op];
+
+	fprintf(stdout, "%-5s records     : %11zu (%.1lf per %s)\n", title,
+		records, (double) records / ops, nb_op_names[op]);
+	fprintf(stdout, "%-5s throughput  : %9.0lf records/sec\n", title,
+		time > 0 ? records / time : 0.0);
+	fprintf(stdout, "%-5s latency     : %7.6lf * 1e-6 sec/record "
+		"(amortized)\n", title, records > 0 ? 1e6 * time / records : 0.0);
+}
+
+static void
+nb_report_threads(struct nb_engine *engine)
+{
+	double start = engine->workers[0].start;
+	double stop = engine->workers[0].stop;
+	double min_rate = 0.0;
+	double max_rate = 0.0;
+	size_t total_count = 0;
+
+	fprintf(stdout, "Threads:\n");
+	for (size_t i = 0; i < engine->workers_count; i++) {
+		struct nb_worker *w = &engine->workers[i];
+		size_t done = atomic_load(&w->done) - w->warmup_done;
+		double elapsed = w->stop - w->start;
+		double rate = elapsed > 0 ? done / elapsed : 0.0;
+
+		fprintf(stdout, "Thread %3zu        : %11zu ops in %7.3lf sec, "
+			"%9.0lf ops/sec\n", i, done, elapsed, rate);
+
+		if (w->start < start)
+			start = w->start;
+		if (w->stop > stop)
+			stop = w->stop;
+		if (i == 0 || rate < min_rate)
+			min_rate = rate;
+		if (i == 0 || rate > max_rate)
+			max_rate = rate;
+		total_count += done;
+	}
+
+	fprintf(stdout, "Total throughput  : %9.0lf ops/sec\n",
+		total_count / (stop - start));
+	fprintf(stdout, "Thread skew       : %9.0lf - %9.0lf ops/sec "
+		"(max/min %.3lf)\n", min_rate, max_rate,
+		min_rate > 0 ? max_rate / min_rate : 0.0);
+}
+
+/* Requests to every shard, a sharded batch is a request per shard */
+static void
+nb_report_shards(struct nb_engine *engine, struct nb_stats *stats)
+{
+	double start = engine->workers[0].start;
+	double stop = engine->workers[0].stop;
+	for (size_t i = 1; i < engine->workers_count; i++) {
+		if (engine->workers[i].start < start)
+			start = engine->workers[i].start;
+		if (engine->workers[i].stop > stop)
+			stop = engine->workers[i].stop;
+	}
+	double elapsed = stop - start;
+
+	size_t total = 0;
+	for (size_t s = 0; s < stats->shards; s++)
+		total += stats->shard_ops[s];
+
+	size_t min_ops = 0;
+	size_t max_ops = 0;
+	fprintf(stdout, "Shards:\n");
+	for (size_t s = 0; s < stats->shards; s++) {
+		size_t ops = stats->shard_ops[s];
+		double time = stats->shard_time[s];
+
+		fprintf(stdout, "Shard %3zu         : %11zu ops (%6.2lf%%), "
+			"%9.0lf ops/sec, %.6lf * 1e-6 sec/op", s, ops,
+			total > 0 ? 1e2 * ops / total : 0.0,
+			elapsed > 0 ? ops / elapsed : 0.0,
+			ops > 0 ? 1e6 * time / ops : 0.0);
+
+		const char *path = engine->shard_opts[s].path;
+		struct nb_io io;
+		if (engine->opts->io_stats && nb_io_read(&io, path) == 0) {
+			fprintf(stdout, ", %llu bytes on disk",
+				(unsigned long long) io.disk_size);
+		}
+		fprintf(stdout, "\n");
+
+		if (s == 0 || ops < min_ops)
+			min_ops = ops;
+		if (s == 0 || ops > max_ops)
+			max_ops = ops;
+	}
+
+	fprintf(stdout, "Shard skew        : %11zu - %zu ops (max/min "
+		"%.3lf)\n", min_ops, max_ops,
+		min_ops > 0 ? (double) max_ops / min_ops : 0.0);
+}
+
+/*
+ * Throughput of every segment of a churn run. Deleted keys leave
+ * tombstones behind, so later segments show how the engine copes with
+ * them.
+ */
+static void
+nb_report_churn(struct nb_engine *engine)
+{
+	size_t segments = NB_SEGMENTS;
+	for (size_t i = 0; i < engine->workers_count; i++) {
+		if (engine->workers[i].segments_done < segments)
+			segments = engine->workers[i].segments_done;
+	}
+	if (segments == 0)
+		return;
+
+	double first_rate = 0.0;
+	double last_rate = 0.0;
+
+	fprintf(stdout, "Churn:\n");
+	for (size_t s = 0; s < segments; s++) {
+		double rate = 0.0;
+		size_t deleted = 0;
+		for (size_t i = 0; i < engine->workers_count; i++) {
+			struct nb_worker *w = &engine->workers[i];
+			size_t begin = w->count * s / NB_SEGMENTS;
+			size_t end = w->count * (s + 1) / NB_SEGMENTS;
+			double t0 = (s > 0) ? w->segments[s - 1] : w->begin;
+			double elapsed = w->segments[s] - t0;
+			if (elapsed > 0)
+				rate += (end - begin) / elapsed;
+			/* every even op is a delete */
+			deleted += (end + 1) / 2;
+		}
+
+		if (s == 0)
+			first_rate = rate;
+		last_rate = rate;
+		fprintf(stdout, "Segment %3zu       : %11zu deleted, "
+			"%9.0lf ops/sec\n", s + 1, deleted, rate);
+	}
+
+	fprintf(stdout, "Throughput decay  : %9.3lf (last/first segment)\n",
+		first_rate > 0 ? last_rate / first_rate : 0.0);
+}
+
+/*
+ * A histogram file is a sequence of records, every record is a name on
+ * its own line followed by nb_histogram_save() output.
+ */
+static int
+nb_report_write_histogram(FILE *file, const char *name,
+			  const struct nb_histogram *hist)
+{
+	fprintf(file, "%s\n", name);
+	return nb_histogram_save(hist, file);
+}
+
+static int
+nb_report_save_histograms(struct nb_stats *stats, struct nb_histogram *hist,
+			  struct nb_histogram *hist_corrected,
+			  const char *filename)
+{
+	FILE *file = fopen(filename, "wb");
+	if (file == NULL) {
+		perror("fopen");
+		return -1;
+	}
+
+	int rc = nb_report_write_histogram(file, "total", hist);
+	if (rc == 0 && hist_corrected != NULL)
+		rc = nb_report_write_histogram(file, "total.corrected",
+					       hist_corrected);
+
+	for (int op = 0; rc == 0 && op < NB_OP_MAX; op++) {
+		if (nb_stats_count(stats, op) == 0)
+			continue;
+		rc = nb_report_write_histogram(file, nb_op_names[op],
+					       stats->hist[op]);
+		if (rc != 0 || hist_corrected == NULL)
+			continue;
+		char name[64];
+		snprintf(name, sizeof(name), "%s.corrected", nb_op_names[op]);
+		rc = nb_report_write_histogram(file, name,
+					       stats->hist_corrected[op]);
+	}
+
+	if (fclose(file) != 0)
+		rc = -1;
+	if (rc != 0)
+		fprintf(stderr, "Failed to write %s\n", filename);
+
+	return rc;
+}
+
+int
+nb_report(struct nb_engine *engine, struct nb_stats *stats)
+{
+	bool corrected = engine->opts->rate > 0;
+
+	int digits = engine->opts->hist_digits;
+	struct nb_histogram *hist = nb_histogram_new(6, digits);
+	if (hist == NULL) {
+		fprintf(stderr, "nb_histogram_new() failed\n");
+		goto error_1;
+	}
+
+	struct nb_histogram *hist_corrected = NULL;
+	if (corrected) {
+		hist_corrected = nb_histogram_new(6, digits);
+		if (hist_corrected == NULL) {
+			fprintf(stderr, "nb_histogram_new() failed\n");
+			goto error_2;
+		}
+	}
+
+	int ops_used = 0;
+	for (int op = 0; op < NB_OP_MAX; op++) {
+		if (nb_stats_count(stats, op) == 0)
+			continue;
+		ops_used++;
+		nb_histogram_merge(hist, stats->hist[op]);
+		if (corrected)
+			nb_histogram_merge(hist_corrected,
+					   stats->hist_corrected[op]);
+	}
+
+	if (ops_used > 1) {
+		for (int op = 0; op < NB_OP_MAX; op++) {
+			if (nb_stats_count(stats, op) == 0)
+				continue;
+			fprintf(stdout, "Histogram (%s):\n", nb_op_names[op]);
+			nb_histogram_dump(stats->hist[op], stdout,
+					  percentiles, percentiles_size);
+		}
+		fprintf(stdout, "Operations:\n");
+		for (int op = 0; op < NB_OP_MAX; op++) {
+			size_t size = nb_stats_count(stats, op);
+			if (size == 0)
+				continue;
+			fprintf(stdout, "%-18s: %11zu (%6.2lf%%)\n",
+				nb_op_names[op], size,
+				1e2 * size / nb_histogram_size(hist));
+		}
+	}
+
+	fprintf(stdout, "Histogram:\n");
+	nb_histogram_dump(hist, stdout, percentiles, percentiles_size);
+
+	if (engine->opts->histogram_out != NULL &&
+	    nb_report_save_histograms(stats, hist, hist_corrected,
+				      engine->opts->histogram_out) != 0) {
+		if (hist_corrected != NULL)
+			nb_histogram_delete(hist_corrected);
+		goto error_2;
+	}
+
+	if (corrected) {
+		fprintf(stdout, "Histogram (corrected for coordinated "
+			"omission):\n");
+		nb_histogram_dump(hist_corrected, stdout, percentiles,
+				  percentiles_size);
+
+		for (int op = 0; ops_used > 1 && op < NB_OP_MAX; op++) {
+			if (nb_stats_count(stats, op) == 0)
+				continue;
+			char title[64];
+			snprintf(title, sizeof(title), "Percentiles (%s)",
+				 nb_op_names[op]);
+			nb_report_percentiles(title, stats->hist[op],
+					      stats->hist_corrected[op]);
+		}
+		nb_report_percentiles("Percentiles", hist, hist_corrected);
+		nb_histogram_delete(hist_corrected);
+	}
+
+	if (engine->opts->verify) {
+		fprintf(stdout, "Verified records  : %11zu\n", stats->verified);
+		fprintf(stdout, "Corrupted records : %11zu\n", stats->corrupted);
+		fprintf(stdout, "Missing records   : %11zu\n", stats->missing);
+	}
+
+	if (engine->opts->perf_counters) {
+		nb_report_perf(engine, nb_histogram_size(hist));
+	}
+
+	if (engine->opts->io_stats) {
+		nb_report_io(engine, stats);
+	}
+
+	if (engine->opts->memory_stats) {
+		nb_report_memory(engine);
+	}
+
+	nb_report_records(stats, NB_OP_BATCH, "Batch");
+	nb_report_records(stats, NB_OP_SCAN, "Scan");
+
+	if (engine->bench_type == NB_BENCH_CHURN) {
+		nb_report_churn(engine);
+	}
+
+	size_t warmup_ops = 0;
+	for (size_t i = 0; i < engine->workers_count; i++) {
+		warmup_ops += engine->workers[i].warmup_done;
+	}
+	if (warmup_ops > 0) {
+		fprintf(stdout, "Warm-up ops       : %11zu (not reported)\n",
+			warmup_ops);
+	}
+
+	/* Latency doesn't define throughput when requests are pipelined */
+	if (engine->workers_count > 1 || engine->opts->queue_depth > 0) {
+		nb_report_threads(engine);
+	}
+
+	if (stats->shards > 1) {
+		nb_report_shards(engine, stats);
+	}
+
+	nb_histogram_delete(hist);
+	return 0;
+
+error_2:
+	nb_histogram_delete(hist);
+error_1:
+	return -1;
+}
+
+/* Histograms with the same name are merged across all files */
+struct nb_merged {
+	char name[64];
+	struct nb_histogram *hist;
+	size_t files;
+};
+
+enum { NB_MERGED_MAX = 2 * (NB_OP_MAX + 1) };
+
+static int
+nb_report_merge_file(struct nb_opts *opts, const char *filename,
+		     struct nb_merged *merged, size_t *merged_count)
+{
+	FILE *file = fopen(filename, "rb");
+	if (file == NULL) {
+		perror(filename);
+		return -1;
+	}
+
+	int rc = -1;
+	char name[64];
+	while (fgets(name, sizeof(name), file) != NULL) {
+		name[strcspn(name, "\n")] = 0;
+
+		struct nb_histogram *hist = nb_histogram_load(file);
+		if (hist == NULL)
+			goto out;
+
+		size_t i = 0;
+		while (i < *merged_count && strcmp(merged[i].name, name) != 0)
+			i++;
+		if (i == *merged_count) {
+			if (i == NB_MERGED_MAX) {
+				fprintf(stderr, "Too many histograms\n");
+				nb_histogram_delete(hist);
+				goto out;
+			}
+			merged[i].hist = nb_histogram_new(6, opts->hist_digits);
+			if (merged[i].hist == NULL) {
+				nb_histogram_delete(hist);
+				goto out;
+			}
+			snprintf(merged[i].name, sizeof(merged[i].name), "%s",
+				 name);
+			merged[i].files = 0;
+			(*merged_count)++;
+		}
+
+		nb_histogram_merge(merged[i].hist, hist);
+		merged[i].files++;
+		nb_histogram_delete(hist);
+	}
+
+	rc = ferror(file) ? -1 : 0;
+out:
+	if (rc != 0)
+		fprintf(stderr, "Failed to read %s\n", filename);
+	fclose(file);
+	return rc;
+}
+
+int
+nb_report_merge(struct nb_opts *opts)
+{
+	if (opts->merge_files_count == 0) {
+		fprintf(stderr, "No histogram files to merge\n");
+		return -1;
+	}
+
+	struct nb_merged merged[NB_MERGED_MAX];
+	size_t merged_count = 0;
+	int rc = 0;
+
+	for (size_t f = 0; f < opts->merge_files_count; f++) {
+		rc = nb_report_merge_file(opts, opts->merge_files[f],
+					  merged, &merged_count);
+		if (rc != 0)
+			goto out;
+	}
+
+	for (size_t i = 0; i < merged_count; i++) {
+		if (nb_histogram_size(merged[i].hist) == 0)
+			continue;
+		fprintf(stdout, "Histogram (%s, %zu files):\n", merged[i].name,
+			merged[i].files);
+		nb_histogram_dump(merged[i].hist, stdout, percentiles,
+				  percentiles_size);
+	}
+
+	if (opts->histogram_out != NULL) {
+		FILE *file = fopen(opts->histogram_out, "wb");
+		if (file == NULL) {
+			perror("fopen");
+			rc = -1;
+			goto out;
+		}
+		for (size_t i = 0; rc == 0 && i < merged_count; i++) {
+			rc = nb_report_write_histogram(file, merged[i].name,
+						       merged[i].hist);
+		}
+		if (fclose(file) != 0)
+			rc = -1;
+		if (rc != 0)
+			fprintf(stderr, "Failed to write %s\n",
+				opts->histogram_out);
+	}
+
+out:
+	for (size_t i = 0; i < merged_count; i++) {
+		nb_histogram_delete(merged[i].hist);
+	}
+	return rc;
+}
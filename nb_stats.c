@@ -0,0 +1,139 @@
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "nb_stats.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "nb_histogram.h"
+
+const char *nb_op_names[NB_OP_MAX] = {
+	"get",
+	"put",
+	"delete",
+	"batch",
+	"scan",
+};
+
+void
+nb_stats_destroy(struct nb_stats *stats)
+{
+	for (int op = 0; op < NB_OP_MAX; op++) {
+		if (stats->hist[op] != NULL)
+			nb_histogram_delete(stats->hist[op]);
+		if (stats->hist_corrected[op] != NULL)
+			nb_histogram_delete(stats->hist_corrected[op]);
+	}
+	free(stats->shard_ops);
+	free(stats->shard_time);
+}
+
+int
+nb_stats_create(struct nb_stats *stats, const bool *used, bool corrected,
+		int digits, size_t shards)
+{
+	memset(stats, 0, sizeof(*stats));
+
+	for (int op = 0; op < NB_OP_MAX; op++) {
+		if (!used[op])
+			continue;
+
+		stats->hist[op] = nb_histogram_new(6, digits);
+		if (stats->hist[op] == NULL)
+			goto error_hist;
+
+		if (!corrected)
+			continue;
+
+		stats->hist_corrected[op] = nb_histogram_new(6, digits);
+		if (stats->hist_corrected[op] == NULL)
+			goto error_hist;
+	}
+
+	if (shards > 1) {
+		stats->shards = shards;
+		stats->shard_ops = calloc(shards, sizeof(*stats->shard_ops));
+		stats->shard_time = calloc(shards, sizeof(*stats->shard_time));
+		if (stats->shard_ops == NULL || stats->shard_time == NULL) {
+			fprintf(stderr, "shard stats malloc failed\n");
+			goto error;
+		}
+	}
+
+	return 0;
+
+error_hist:
+	fprintf(stderr, "nb_histogram_new() failed\n");
+error:
+	nb_stats_destroy(stats);
+	return -1;
+}
+
+size_t
+nb_stats_count(const struct nb_stats *stats, enum nb_op op)
+{
+	return stats->hist[op] != NULL ? nb_histogram_size(stats->hist[op]) : 0;
+}
+
+size_t
+nb_stats_footprint(const struct nb_stats *stats)
+{
+	size_t size = 0;
+	for (int op = 0; op < NB_OP_MAX; op++) {
+		if (stats->hist[op] != NULL)
+			size += nb_histogram_footprint(stats->hist[op]);
+		if (stats->hist_corrected[op] != NULL)
+			size += nb_histogram_footprint(stats->hist_corrected[op]);
+	}
+	return size;
+}
+
+void
+nb_stats_merge(struct nb_stats *dst, const struct nb_stats *src)
+{
+	for (int op = 0; op < NB_OP_MAX; op++) {
+		if (dst->hist[op] != NULL)
+			nb_histogram_merge(dst->hist[op], src->hist[op]);
+		if (dst->hist_corrected[op] != NULL)
+			nb_histogram_merge(dst->hist_corrected[op],
+					   src->hist_corrected[op]);
+		dst->records[op] += src->records[op];
+		dst->time[op] += src->time[op];
+		dst->bytes[op] += src->bytes[op];
+	}
+	dst->verified += src->verified;
+	dst->corrupted += src->corrupted;
+	dst->missing += src->missing;
+	for (size_t s = 0; s < dst->shards; s++) {
+		dst->shard_ops[s] += src->shard_ops[s];
+		dst->shard_time[s] += src->shard_time[s];
+	}
+}
@@ -0,0 +1,95 @@
+#ifndef NB_STATS_H_INCLUDED
+#define NB_STATS_H_INCLUDED
+
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct nb_histogram;
+
+enum nb_op {
+	NB_OP_GET,
+	NB_OP_PUT,
+	NB_OP_DELETE,
+	NB_OP_BATCH,
+	NB_OP_SCAN,
+	NB_OP_MAX
+};
+
+extern const char *nb_op_names[NB_OP_MAX];
+
+/* Latency histograms for every type of operation used by the workload */
+struct nb_stats {
+	struct nb_histogram *hist[NB_OP_MAX];
+	/* latency measured from the intended start time (open-loop mode) */
+	struct nb_histogram *hist_corrected[NB_OP_MAX];
+	/* records processed by multi-record ops (scans, batches) */
+	size_t records[NB_OP_MAX];
+	/* total time spent in ops */
+	double time[NB_OP_MAX];
+	/* bytes of keys and values written */
+	uint64_t bytes[NB_OP_MAX];
+	/* GET results checked by --verify */
+	size_t verified;
+	size_t corrupted;
+	size_t missing;
+	/* requests to every shard and time spent in them (--shards) */
+	size_t shards;
+	size_t *shard_ops;
+	double *shard_time;
+};
+
+/*
+ * Histograms take up to tens of MB with 5 digits, so only ops in `used`
+ * get them. Corrected histograms are created for the open-loop mode only.
+ */
+int
+nb_stats_create(struct nb_stats *stats, const bool *used, bool corrected,
+		int digits, size_t shards);
+
+/* Also works for stats which were never created, but zeroed */
+void
+nb_stats_destroy(struct nb_stats *stats);
+
+/* Number of ops of the type, zero for ops without a histogram */
+size_t
+nb_stats_count(const struct nb_stats *stats, enum nb_op op);
+
+/* Bytes of memory taken by histograms */
+size_t
+nb_stats_footprint(const struct nb_stats *stats);
+
+/* Add `src` to `dst`, both are created for the same ops */
+void
+nb_stats_merge(struct nb_stats *dst, const struct nb_stats *src);
+
+#endif /* NB_STATS_H_INCLUDED */
@@ -27,18 +27,211 @@
  * SUCH DAMAGE.
  */
 
-#include "time.h"
+#include "nb_time.h"
 
+#include <stdio.h>
 #include <time.h>
 
-double
-nb_clock(void)
+#if defined(__x86_64__) || defined(__i386__)
+#define NB_TIME_HAVE_TSC 1
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif /* defined(__x86_64__) || defined(__i386__) */
+
+const char *nb_timer_type_names[NB_TIMER_MAX] = {
+	[NB_TIMER_AUTO] = "auto",
+	[NB_TIMER_TSC] = "tsc",
+	[NB_TIMER_CLOCK] = "clock",
+};
+
+/* Calibration takes this long, 1 us of error is 10 ppm */
+static const double nb_time_calibration = 0.1;
+
+static struct {
+	enum nb_timer_type source;
+	/* nb_clock() = base + (tsc - tsc_base) * tsc_scale */
+	double base;
+	uint64_t tsc_base;
+	double tsc_scale;
+	uint64_t overhead;
+} nb_time = {
+	.source = NB_TIMER_CLOCK,
+};
+
+static inline double
+nb_clock_gettime(void)
 {
 	struct timespec t;
-	clock_gettime(CLOCK_MONOTONIC_RAW, &t);
+	clock_gettime(CLOCK_MONOTONIC, &t);
 	return t.tv_sec + 1e-9 * t.tv_nsec;
 }
 
+#if defined(NB_TIME_HAVE_TSC)
+
+/*
+ * RDTSCP waits for preceding instructions to complete and LFENCE keeps
+ * the following ones from starting before the read, so the same read
+ * can be used at both ends of a measured interval.
+ */
+static inline uint64_t
+nb_tsc(void)
+{
+	unsigned aux;
+	uint64_t tsc = __rdtscp(&aux);
+	_mm_lfence();
+	return tsc;
+}
+
+/* 0 - no RDTSCP, 1 - the TSC may drift, 2 - invariant TSC */
+static int
+nb_tsc_check(void)
+{
+	unsigned eax, ebx, ecx, edx;
+	if (__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) == 0 ||
+	    eax < 0x80000007)
+		return 0;
+	__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx);
+	if ((edx & (1U << 27)) == 0)
+		return 0;
+	__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+	return (edx & (1U << 8)) != 0 ? 2 : 1;
+}
+
+/* Read the clock and the TSC at the same time, as close as possible */
+static void
+nb_tsc_pair(uint64_t *tsc, double *sec)
+{
+	uint64_t best = UINT64_MAX;
+	for (int i = 0; i < 16; i++) {
+		uint64_t t0 = nb_tsc();
+		double s = nb_clock_gettime();
+		uint64_t t1 = nb_tsc();
+		if (i == 0 || t1 - t0 < best) {
+			best = t1 - t0;
+			*tsc = t0 + (t1 - t0) / 2;
+			*sec = s;
+		}
+	}
+}
+
+static int
+nb_tsc_calibrate(void)
+{
+	uint64_t tsc0, tsc1;
+	double sec0, sec1;
+
+	nb_tsc_pair(&tsc0, &sec0);
+	struct timespec ts;
+	ts.tv_sec = 0;
+	ts.tv_nsec = (long) (nb_time_calibration * 1e9);
+	nanosleep(&ts, NULL);
+	nb_tsc_pair(&tsc1, &sec1);
+
+	if (tsc1 <= tsc0 || sec1 <= sec0) {
+		fprintf(stderr, "TSC calibration failed\n");
+		return -1;
+	}
+
+	nb_time.base = sec1;
+	nb_time.tsc_base = tsc1;
+	nb_time.tsc_scale = (sec1 - sec0) / (double) (tsc1 - tsc0);
+	return 0;
+}
+
+#endif /* defined(NB_TIME_HAVE_TSC) */
+
+double
+nb_clock(void)
+{
+#if defined(NB_TIME_HAVE_TSC)
+	if (nb_time.source == NB_TIMER_TSC) {
+		return nb_time.base +
+		       (double) (int64_t) (nb_tsc() - nb_time.tsc_base) *
+		       nb_time.tsc_scale;
+	}
+#endif /* defined(NB_TIME_HAVE_TSC) */
+	return nb_clock_gettime();
+}
+
+/*
+ * A measured interval includes the cost of one read of the clock: the
+ * part of the first read after the time is taken and the part of the
+ * second one before it. Use the best average over runs of reads.
+ */
+static void
+nb_time_measure_overhead(void)
+{
+	enum { ROUNDS = 100, READS = 100 };
+
+	double best = 1.0;
+	for (int r = 0; r < ROUNDS; r++) {
+		double t0 = nb_clock();
+		double t1 = t0;
+		for (int i = 0; i < READS; i++)
+			t1 = nb_clock();
+		if ((t1 - t0) / READS < best)
+			best = (t1 - t0) / READS;
+	}
+	nb_time.overhead = (uint64_t) (best * 1e9 + 0.5);
+}
+
+int
+nb_time_init(enum nb_timer_type type)
+{
+	nb_time.source = NB_TIMER_CLOCK;
+
+	if (type != NB_TIMER_CLOCK) {
+#if defined(NB_TIME_HAVE_TSC)
+		int tsc = nb_tsc_check();
+		if (type == NB_TIMER_TSC && tsc == 0) {
+			fprintf(stderr, "The CPU doesn't support RDTSCP\n");
+			return -1;
+		}
+		if (type == NB_TIMER_TSC && tsc == 1) {
+			fprintf(stderr, "Warning: the TSC is not invariant, "
+				"latencies may be wrong\n");
+		}
+		if (tsc == 2 || (type == NB_TIMER_TSC && tsc == 1)) {
+			if (nb_tsc_calibrate() != 0) {
+				if (type == NB_TIMER_TSC)
+					return -1;
+			} else {
+				nb_time.source = NB_TIMER_TSC;
+			}
+		}
+#else
+		if (type == NB_TIMER_TSC) {
+			fprintf(stderr, "TSC is not supported on this "
+				"platform\n");
+			return -1;
+		}
+#endif /* defined(NB_TIME_HAVE_TSC) */
+	}
+
+	nb_time_measure_overhead();
+	return 0;
+}
+
+enum nb_timer_type
+nb_time_source(void)
+{
+	return nb_time.source;
+}
+
+double
+nb_time_tsc_hz(void)
+{
+	if (nb_time.source != NB_TIMER_TSC)
+		return 0.0;
+	return 1.0 / nb_time.tsc_scale;
+}
+
+uint64_t
+nb_time_overhead(void)
+{
+	return nb_time.overhead;
+}
+
 double
 nb_now(void)
 {
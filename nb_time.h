@@ -30,6 +30,41 @@
  * SUCH DAMAGE.
  */
 
+#include <stdint.h>
+
+/* Source of nb_clock() */
+enum nb_timer_type {
+	/* TSC if it's invariant, clock_gettime() otherwise */
+	NB_TIMER_AUTO,
+	/* RDTSCP calibrated against CLOCK_MONOTONIC */
+	NB_TIMER_TSC,
+	/* clock_gettime(CLOCK_MONOTONIC) */
+	NB_TIMER_CLOCK,
+	NB_TIMER_MAX
+};
+
+extern const char *nb_timer_type_names[NB_TIMER_MAX];
+
+/*
+ * Choose the source of nb_clock(), calibrate the TSC and measure the cost
+ * of reading the clock. Until then nb_clock() uses clock_gettime().
+ */
+int
+nb_time_init(enum nb_timer_type type);
+
+/* The source chosen by nb_time_init(), TSC or CLOCK */
+enum nb_timer_type
+nb_time_source(void);
+
+/* TSC frequency in Hz, 0 if the TSC is not used */
+double
+nb_time_tsc_hz(void);
+
+/* Time added to a measured interval by reading the clock, in nanoseconds */
+uint64_t
+nb_time_overhead(void);
+
+/* Monotonic time in seconds, for intervals only */
 double
 nb_clock(void);
 
@@ -0,0 +1,108 @@
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "nb_value.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Values are never longer than a half of the pool */
+enum { NB_VALUE_POOL_MIN = 1024 * 1024 };
+
+/* Data is generated in pieces, every piece repeats a random prefix */
+enum { NB_VALUE_PIECE = 100 };
+
+int
+nb_value_pool_create(struct nb_value_pool *pool, uint64_t seed)
+{
+	int rc = 0;
+
+	rc--;
+	if (nb_random_sizes_create(&pool->sizes) != 0)
+		goto error_1;
+
+	rc--;
+	if (pool->compression <= 0.0 || pool->compression > 1.0) {
+		fprintf(stderr, "Compression ratio must be in (0, 1]: %lf\n",
+			pool->compression);
+		goto error_2;
+	}
+
+	rc--;
+	pool->size = pool->sizes.max * 2;
+	if (pool->size < NB_VALUE_POOL_MIN)
+		pool->size = NB_VALUE_POOL_MIN;
+	pool->data = malloc(pool->size);
+	if (pool->data == NULL) {
+		fprintf(stderr, "value pool malloc failed\n");
+		goto error_2;
+	}
+
+	pool->seed = seed;
+	size_t raw = (size_t) (NB_VALUE_PIECE * pool->compression);
+	if (raw == 0)
+		raw = 1;
+	for (size_t off = 0; off < pool->size; off += NB_VALUE_PIECE) {
+		char *piece = pool->data + off;
+		size_t len = pool->size - off < NB_VALUE_PIECE ?
+			     pool->size - off : NB_VALUE_PIECE;
+		for (size_t i = 0; i < len; i++) {
+			piece[i] = (i < raw) ?
+				   (char) (' ' + nb_random_u64(&seed) % 95) :
+				   piece[i % raw];
+		}
+	}
+
+	return 0;
+
+error_2:
+	nb_random_sizes_destroy(&pool->sizes);
+error_1:
+	return rc;
+}
+
+void
+nb_value_pool_destroy(struct nb_value_pool *pool)
+{
+	free(pool->data);
+	nb_random_sizes_destroy(&pool->sizes);
+}
+
+const char *
+nb_value_get(const struct nb_value_pool *pool, const void *key,
+	     size_t key_len, size_t *len)
+{
+	uint64_t rng = nb_random_hash(key, key_len, pool->seed);
+
+	*len = nb_random_sizes_next(&pool->sizes, &rng);
+	size_t pos = nb_random_u64(&rng) % (pool->size - *len + 1);
+
+	return pool->data + pos;
+}
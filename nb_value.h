@@ -0,0 +1,65 @@
+#ifndef NB_VALUE_H_INCLUDED
+#define NB_VALUE_H_INCLUDED
+
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nb_random.h"
+
+/*
+ * A read-only pool of pseudo-random data compressible to `compression`
+ * of its size, shared by all threads. Values are slices of the pool, as
+ * in RandomGenerator of the LevelDB db_bench. The slice is chosen by a
+ * hash of the key, so the value of a key can be checked later.
+ */
+struct nb_value_pool {
+	struct nb_random_sizes sizes;
+	double compression;
+
+	char *data;
+	size_t size;
+	uint64_t seed;
+};
+
+/* Fill the pool using the parameters set by the caller */
+int
+nb_value_pool_create(struct nb_value_pool *pool, uint64_t seed);
+
+void
+nb_value_pool_destroy(struct nb_value_pool *pool);
+
+/* The value of the key, valid as long as the pool */
+const char *
+nb_value_get(const struct nb_value_pool *pool, const void *key,
+	     size_t key_len, size_t *len);
+
+#endif /* NB_VALUE_H_INCLUDED */
@@ -47,6 +47,8 @@ typedef	unsigned long	u_long;
 struct nb_db_berkeleydb {
 	DB_ENV *env;
 	DB *db;
+	/* opened with DB_THREAD */
+	int threaded;
 };
 
 static struct nb_db *
@@ -92,6 +94,10 @@ nb_db_berkeleydb_open(const struct nb_db_opts *opts)
 	r = env->log_set_config(env, log_flags, 1);
 
 	int env_open_flags = DB_CREATE|DB_INIT_MPOOL;
+	if (opts->threads > 1) {
+		/* Handles must be free-threaded and writers serialized */
+		env_open_flags |= DB_THREAD|DB_INIT_LOCK;
+	}
 	r = env->open(env, opts->path, env_open_flags, 0666);
 	if (r != 0) {
 		fprintf(stderr, "env->open: %s\n",
@@ -105,6 +111,9 @@ nb_db_berkeleydb_open(const struct nb_db_opts *opts)
 		goto error_2;
 	}
 	int open_flags = DB_CREATE;
+	if (opts->threads > 1) {
+		open_flags |= DB_THREAD;
+	}
 	r = db->open(db, NULL, "data.bdb", NULL, DB_BTREE, open_flags, 0664);
 	if (r != 0) {
 		fprintf(stderr, "db->open: %s\n",
@@ -114,6 +123,7 @@ nb_db_berkeleydb_open(const struct nb_db_opts *opts)
 
 	berkeleydb->env = env;
 	berkeleydb->db = db;
+	berkeleydb->threaded = (opts->threads > 1);
 	return (struct nb_db *) berkeleydb;
 
 error_3:
@@ -175,7 +185,7 @@ nb_db_berkeleydb_remove(struct nb_db *db, const void *key, size_t key_len)
 	dbkey.size = key_len;
 
 	int r = berkeleydb->db->del(berkeleydb->db, NULL, &dbkey, 0);
-	if (r == DB_NOTFOUND) {
+	if (r != 0) {
 		fprintf(stderr, "db->del() failed: %s\n",
 			db_strerror(r));
 		return -1;
@@ -197,7 +207,8 @@ nb_db_berkeleydb_select(struct nb_db *db, const void *key, size_t key_len,
 	dbkey.data = (void *) key;
 	dbkey.size = key_len;
 
-	if (pval != NULL) {
+	/* DB_THREAD handles can't return data in the internal buffer */
+	if (pval != NULL || berkeleydb->threaded) {
 		dbval.flags = DB_DBT_MALLOC;
 	}
 
@@ -211,6 +222,94 @@ nb_db_berkeleydb_select(struct nb_db *db, const void *key, size_t key_len,
 	if (pval) {
 		*pval = dbval.data;
 		*pval_len = dbval.size;
+	} else if (berkeleydb->threaded) {
+		free(dbval.data);
+	}
+
+	return 0;
+}
+
+static int
+nb_db_berkeleydb_select_into(struct nb_db *db, const void *key, size_t key_len,
+			     void *buf, size_t buf_size, size_t *pval_len)
+{
+	struct nb_db_berkeleydb *berkeleydb = (struct nb_db_berkeleydb *) db;
+
+	assert (buf_size <= UINT32_MAX);
+
+	DBT dbkey, dbval;
+	memset(&dbkey, 0, sizeof(dbkey));
+	memset(&dbval, 0, sizeof(dbval));
+
+	dbkey.data = (void *) key;
+	dbkey.size = key_len;
+	dbval.data = buf;
+	dbval.ulen = buf_size;
+	dbval.flags = DB_DBT_USERMEM;
+
+	int r = berkeleydb->db->get(berkeleydb->db, NULL, &dbkey, &dbval, 0);
+	if (r == DB_BUFFER_SMALL) {
+		*pval_len = dbval.size;
+		return 1;
+	} else if (r != 0) {
+		fprintf(stderr, "db->get() failed: %s\n",
+			db_strerror(r));
+		return -1;
+	}
+
+	*pval_len = dbval.size;
+	return 0;
+}
+
+static int
+nb_db_berkeleydb_write_batch(struct nb_db *db,
+			     const struct nb_db_record *records, size_t count)
+{
+	struct nb_db_berkeleydb *berkeleydb = (struct nb_db_berkeleydb *) db;
+
+	/*
+	 * Bulk buffer: records grow from the beginning, offsets and lengths
+	 * (four u_int32_t per record) grow from the end.
+	 */
+	size_t size = sizeof(u_int32_t);
+	for (size_t i = 0; i < count; i++) {
+		size += records[i].key_len + records[i].val_len +
+			4 * sizeof(u_int32_t);
+	}
+	size = (size + 1023) / 1024 * 1024;
+
+	DBT dbkey, dbval;
+	memset(&dbkey, 0, sizeof(dbkey));
+	memset(&dbval, 0, sizeof(dbval));
+
+	dbkey.data = malloc(size);
+	if (dbkey.data == NULL) {
+		fprintf(stderr, "malloc(%zu) failed", size);
+		return -1;
+	}
+	dbkey.ulen = size;
+	dbkey.flags = DB_DBT_USERMEM | DB_DBT_BULK;
+
+	void *p;
+	DB_MULTIPLE_WRITE_INIT(p, &dbkey);
+	for (size_t i = 0; i < count; i++) {
+		DB_MULTIPLE_KEY_WRITE_NEXT(p, &dbkey,
+					   records[i].key, records[i].key_len,
+					   records[i].val, records[i].val_len);
+		if (p == NULL) {
+			fprintf(stderr, "bulk buffer is too small\n");
+			free(dbkey.data);
+			return -1;
+		}
+	}
+
+	int r = berkeleydb->db->put(berkeleydb->db, NULL, &dbkey, &dbval,
+				    DB_MULTIPLE_KEY);
+	free(dbkey.data);
+	if (r != 0) {
+		fprintf(stderr, "db->put() failed: %s\n",
+			db_strerror(r));
+		return -1;
 	}
 
 	return 0;
@@ -223,6 +322,92 @@ nb_db_berkeleydb_valfree(struct nb_db *db, void *val)
 	free(val);
 }
 
+struct nb_db_berkeleydb_cursor {
+	DBC *dbc;
+	DBT key;
+	DBT val;
+	int started;
+};
+
+static struct nb_db_cursor *
+nb_db_berkeleydb_cursor_seek(struct nb_db *db, const void *key, size_t key_len)
+{
+	struct nb_db_berkeleydb *berkeleydb = (struct nb_db_berkeleydb *) db;
+
+	struct nb_db_berkeleydb_cursor *cursor = calloc(1, sizeof(*cursor));
+	if (cursor == NULL) {
+		fprintf(stderr, "malloc(%zu) failed", sizeof(*cursor));
+		goto error_1;
+	}
+
+	/* DB_SET_RANGE returns the found key in the same DBT */
+	cursor->key.data = malloc(key_len);
+	if (cursor->key.data == NULL) {
+		fprintf(stderr, "malloc(%zu) failed", key_len);
+		goto error_2;
+	}
+	memcpy(cursor->key.data, key, key_len);
+	cursor->key.size = key_len;
+	cursor->key.flags = DB_DBT_REALLOC;
+	cursor->val.flags = DB_DBT_REALLOC;
+
+	int r = berkeleydb->db->cursor(berkeleydb->db, NULL, &cursor->dbc, 0);
+	if (r != 0) {
+		fprintf(stderr, "db->cursor() failed: %s\n",
+			db_strerror(r));
+		goto error_3;
+	}
+
+	return (struct nb_db_cursor *) cursor;
+
+error_3:
+	free(cursor->key.data);
+error_2:
+	free(cursor);
+error_1:
+	return NULL;
+}
+
+static int
+nb_db_berkeleydb_cursor_next(struct nb_db_cursor *c,
+			  const void **pkey, size_t *pkey_len,
+			  const void **pval, size_t *pval_len)
+{
+	struct nb_db_berkeleydb_cursor *cursor =
+			(struct nb_db_berkeleydb_cursor *) c;
+
+	int flags = cursor->started ? DB_NEXT : DB_SET_RANGE;
+	cursor->started = 1;
+
+	int r = cursor->dbc->get(cursor->dbc, &cursor->key, &cursor->val,
+				   flags);
+	if (r == DB_NOTFOUND) {
+		return 1;
+	} else if (r != 0) {
+		fprintf(stderr, "dbc->get() failed: %s\n", db_strerror(r));
+		return -1;
+	}
+
+	*pkey = cursor->key.data;
+	*pkey_len = cursor->key.size;
+	*pval = cursor->val.data;
+	*pval_len = cursor->val.size;
+
+	return 0;
+}
+
+static void
+nb_db_berkeleydb_cursor_close(struct nb_db_cursor *c)
+{
+	struct nb_db_berkeleydb_cursor *cursor =
+			(struct nb_db_berkeleydb_cursor *) c;
+
+	cursor->dbc->close(cursor->dbc);
+	free(cursor->key.data);
+	free(cursor->val.data);
+	free(cursor);
+}
+
 static struct nb_db_if plugin = {
 	.name       = "berkeleydb",
 	.open       = nb_db_berkeleydb_open,
@@ -231,6 +416,11 @@ static struct nb_db_if plugin = {
 	.remove     = nb_db_berkeleydb_remove,
 	.select     = nb_db_berkeleydb_select,
 	.valfree    = nb_db_berkeleydb_valfree,
+	.select_into  = nb_db_berkeleydb_select_into,
+	.write_batch  = nb_db_berkeleydb_write_batch,
+	.cursor_seek  = nb_db_berkeleydb_cursor_seek,
+	.cursor_next  = nb_db_berkeleydb_cursor_next,
+	.cursor_close = nb_db_berkeleydb_cursor_close,
 };
 
 NB_DB_PLUGIN const struct nb_db_if *
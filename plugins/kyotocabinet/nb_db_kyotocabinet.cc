@@ -37,6 +37,9 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <map>
+#include <string>
+
 #include <kcpolydb.h>
 
 struct nb_db_kyotocabinet {
@@ -132,17 +135,64 @@ nb_db_kyotocabinet_select(struct nb_db *db, const void *key, size_t key_len,
 {
 	struct nb_db_kyotocabinet *kc = (struct nb_db_kyotocabinet *) db;
 
-	assert (pval == NULL);
+	if (pval == NULL) {
+		if (kc->instance.get((const char *) key, key_len,
+				     NULL, 0) < 0) {
+			fprintf(stderr, "db->select() failed\n");
+			return -1;
+		}
+		return 0;
+	}
+
+	/* the value is allocated with new[] */
+	*pval = kc->instance.get((const char *) key, key_len, pval_len);
+	if (*pval == NULL) {
+		fprintf(stderr, "db->select() failed\n");
+		return -1;
+	}
+
+	return 0;
+}
 
-	(void) pval;
-	(void) pval_len;
+static int
+nb_db_kyotocabinet_select_into(struct nb_db *db, const void *key,
+			       size_t key_len, void *buf, size_t buf_size,
+			       size_t *pval_len)
+{
+	struct nb_db_kyotocabinet *kc = (struct nb_db_kyotocabinet *) db;
 
-	if (!kc->instance.get((const char *) key, key_len,
-			      NULL, 0)) {
+	int32_t r = kc->instance.get((const char *) key, key_len,
+				     (char *) buf, buf_size);
+	if (r < 0) {
 		fprintf(stderr, "db->select() failed\n");
 		return -1;
 	}
 
+	*pval_len = r;
+	return (size_t) r > buf_size ? 1 : 0;
+}
+
+static int
+nb_db_kyotocabinet_write_batch(struct nb_db *db,
+			       const struct nb_db_record *records,
+			       size_t count)
+{
+	struct nb_db_kyotocabinet *kc = (struct nb_db_kyotocabinet *) db;
+
+	std::map<std::string, std::string> recs;
+	for (size_t i = 0; i < count; i++) {
+		std::string key((const char *) records[i].key,
+				records[i].key_len);
+		recs[key].assign((const char *) records[i].val,
+				 records[i].val_len);
+	}
+
+	if (kc->instance.set_bulk(recs, false) < 0) {
+		fprintf(stderr, "db->set_bulk() failed: %s\n",
+			kc->instance.error().name());
+		return -1;
+	}
+
 	return 0;
 }
 
@@ -150,7 +200,78 @@ static void
 nb_db_kyotocabinet_valfree(struct nb_db *db, void *val)
 {
 	(void) db;
-	free(val);
+	delete[] (char *) val;
+}
+
+struct nb_db_kyotocabinet_cursor {
+	kyotocabinet::TreeDB::Cursor *cur;
+	/* the last record returned by get(): the key followed by the value */
+	char *rec;
+	bool valid;
+};
+
+static struct nb_db_cursor *
+nb_db_kyotocabinet_cursor_seek(struct nb_db *db, const void *key,
+			       size_t key_len)
+{
+	struct nb_db_kyotocabinet *kc = (struct nb_db_kyotocabinet *) db;
+
+	struct nb_db_kyotocabinet_cursor *cursor =
+			new struct nb_db_kyotocabinet_cursor();
+	assert (cursor != NULL);
+
+	cursor->cur = kc->instance.cursor();
+	cursor->rec = NULL;
+	/* jump() fails if there are no records after the key */
+	cursor->valid = cursor->cur->jump((const char *) key, key_len);
+
+	return (struct nb_db_cursor *) cursor;
+}
+
+static int
+nb_db_kyotocabinet_cursor_next(struct nb_db_cursor *c,
+			       const void **pkey, size_t *pkey_len,
+			       const void **pval, size_t *pval_len)
+{
+	struct nb_db_kyotocabinet_cursor *cursor =
+			(struct nb_db_kyotocabinet_cursor *) c;
+
+	if (!cursor->valid)
+		return 1;
+
+	delete[] cursor->rec;
+
+	size_t key_len, val_len;
+	const char *val;
+	cursor->rec = cursor->cur->get(&key_len, &val, &val_len, true);
+	if (cursor->rec == NULL) {
+		cursor->valid = false;
+		kyotocabinet::BasicDB::Error err = cursor->cur->db()->error();
+		if (err.code() != kyotocabinet::BasicDB::Error::NOREC) {
+			fprintf(stderr, "cursor->get() failed: %s\n",
+				err.name());
+			return -1;
+		}
+		return 1;
+	}
+
+	*pkey = cursor->rec;
+	*pkey_len = key_len;
+	*pval = val;
+	*pval_len = val_len;
+
+	return 0;
+}
+
+static void
+nb_db_kyotocabinet_cursor_close(struct nb_db_cursor *c)
+{
+	struct nb_db_kyotocabinet_cursor *cursor =
+			(struct nb_db_kyotocabinet_cursor *) c;
+
+	delete[] cursor->rec;
+	delete cursor->cur;
+	delete cursor;
 }
 
 static struct nb_db_if plugin = {
@@ -161,6 +282,11 @@ static struct nb_db_if plugin = {
 	.remove     = nb_db_kyotocabinet_remove,
 	.select     = nb_db_kyotocabinet_select,
 	.valfree    = nb_db_kyotocabinet_valfree,
+	.select_into  = nb_db_kyotocabinet_select_into,
+	.write_batch  = nb_db_kyotocabinet_write_batch,
+	.cursor_seek  = nb_db_kyotocabinet_cursor_seek,
+	.cursor_next  = nb_db_kyotocabinet_cursor_next,
+	.cursor_close = nb_db_kyotocabinet_cursor_close,
 };
 
 extern "C" NB_DB_PLUGIN const struct nb_db_if *
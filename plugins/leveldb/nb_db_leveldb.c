@@ -166,6 +166,31 @@ nb_db_leveldb_select(struct nb_db *db, const void *key, size_t key_len,
 	return 0;
 }
 
+static int
+nb_db_leveldb_write_batch(struct nb_db *db, const struct nb_db_record *records,
+			  size_t count)
+{
+	struct nb_db_leveldb *leveldb = (struct nb_db_leveldb *) db;
+
+	leveldb_writebatch_t *batch = leveldb_writebatch_create();
+	for (size_t i = 0; i < count; i++) {
+		leveldb_writebatch_put(batch,
+				       records[i].key, records[i].key_len,
+				       records[i].val, records[i].val_len);
+	}
+
+	char *err = NULL;
+	leveldb_write(leveldb->instance, leveldb->woptions, batch, &err);
+	leveldb_writebatch_destroy(batch);
+	if (err != NULL) {
+		fprintf(stderr, "leveldb_write() failed: %s\n", err);
+		leveldb_free(err);
+		return -1;
+	}
+
+	return 0;
+}
+
 static void
 nb_db_leveldb_valfree(struct nb_db *db, void *val)
 {
@@ -173,6 +198,70 @@ nb_db_leveldb_valfree(struct nb_db *db, void *val)
 	leveldb_free(val);
 }
 
+struct nb_db_leveldb_cursor {
+	leveldb_iterator_t *iter;
+	int started;
+};
+
+static struct nb_db_cursor *
+nb_db_leveldb_cursor_seek(struct nb_db *db, const void *key, size_t key_len)
+{
+	struct nb_db_leveldb *leveldb = (struct nb_db_leveldb *) db;
+
+	struct nb_db_leveldb_cursor *cursor = malloc(sizeof(*cursor));
+	if (cursor == NULL) {
+		fprintf(stderr, "malloc(%zu) failed", sizeof(*cursor));
+		return NULL;
+	}
+
+	cursor->iter = leveldb_create_iterator(leveldb->instance,
+					       leveldb->roptions);
+	leveldb_iter_seek(cursor->iter, key, key_len);
+	cursor->started = 0;
+
+	return (struct nb_db_cursor *) cursor;
+}
+
+static int
+nb_db_leveldb_cursor_next(struct nb_db_cursor *c,
+			  const void **pkey, size_t *pkey_len,
+			  const void **pval, size_t *pval_len)
+{
+	struct nb_db_leveldb_cursor *cursor =
+			(struct nb_db_leveldb_cursor *) c;
+
+	if (cursor->started) {
+		leveldb_iter_next(cursor->iter);
+	}
+	cursor->started = 1;
+
+	if (!leveldb_iter_valid(cursor->iter)) {
+		char *err = NULL;
+		leveldb_iter_get_error(cursor->iter, &err);
+		if (err != NULL) {
+			printf("leveldb_iter_next() failed: %s\n", err);
+			leveldb_free(err);
+			return -1;
+		}
+		return 1;
+	}
+
+	*pkey = leveldb_iter_key(cursor->iter, pkey_len);
+	*pval = leveldb_iter_value(cursor->iter, pval_len);
+
+	return 0;
+}
+
+static void
+nb_db_leveldb_cursor_close(struct nb_db_cursor *c)
+{
+	struct nb_db_leveldb_cursor *cursor =
+			(struct nb_db_leveldb_cursor *) c;
+
+	leveldb_iter_destroy(cursor->iter);
+	free(cursor);
+}
+
 static struct nb_db_if plugin = {
 	.name       = "leveldb",
 	.open       = nb_db_leveldb_open,
@@ -181,6 +270,10 @@ static struct nb_db_if plugin = {
 	.remove     = nb_db_leveldb_remove,
 	.select     = nb_db_leveldb_select,
 	.valfree    = nb_db_leveldb_valfree,
+	.write_batch  = nb_db_leveldb_write_batch,
+	.cursor_seek  = nb_db_leveldb_cursor_seek,
+	.cursor_next  = nb_db_leveldb_cursor_next,
+	.cursor_close = nb_db_leveldb_cursor_close,
 };
 
 NB_DB_PLUGIN const struct nb_db_if *
@@ -43,6 +43,10 @@
 struct nb_db_tokukv {
 	DB_ENV *env;
 	DB *db;
+	/* opened with DB_THREAD */
+	int threaded;
+	/* opened with DB_INIT_TXN, used to group puts of a write batch */
+	int transactional;
 };
 
 static struct nb_db *
@@ -91,6 +95,12 @@ nb_db_tokukv_open(const struct nb_db_opts *opts)
 #endif
 
 	int env_open_flags = DB_CREATE|DB_PRIVATE|DB_INIT_MPOOL;
+	if (opts->threads > 1) {
+		env_open_flags |= DB_THREAD;
+	}
+	if (opts->batch > 1) {
+		env_open_flags |= DB_INIT_TXN|DB_INIT_LOG|DB_INIT_LOCK;
+	}
 	r = env->open(env, opts->path, env_open_flags, 0644);
 	if (r != 0) {
 		fprintf(stderr, "env->open failed: %s\n", db_strerror(r));
@@ -111,6 +121,12 @@ nb_db_tokukv_open(const struct nb_db_opts *opts)
 	}
 
 	int open_flags = DB_CREATE;
+	if (opts->threads > 1) {
+		open_flags |= DB_THREAD;
+	}
+	if (opts->batch > 1) {
+		open_flags |= DB_AUTO_COMMIT;
+	}
 	r = db->open(db, NULL, "data.bdb", NULL, DB_BTREE, open_flags, 0644);
 	if (r != 0) {
 		fprintf(stderr, "db->open failed: %s\n", db_strerror(r));
@@ -128,6 +144,8 @@ nb_db_tokukv_open(const struct nb_db_opts *opts)
 
 	tokukv->env = env;
 	tokukv->db = db;
+	tokukv->threaded = (opts->threads > 1);
+	tokukv->transactional = (opts->batch > 1);
 	return (struct nb_db *) tokukv;
 
 error_3:
@@ -189,7 +207,7 @@ nb_db_tokukv_remove(struct nb_db *db, const void *key, size_t key_len)
 	dbkey.size = key_len;
 
 	int r = tokukv->db->del(tokukv->db, NULL, &dbkey, 0);
-	if (r == DB_NOTFOUND) {
+	if (r != 0) {
 		fprintf(stderr, "db->del() failed: %s\n",
 			db_strerror(r));
 		return -1;
@@ -211,7 +229,8 @@ nb_db_tokukv_select(struct nb_db *db, const void *key, size_t key_len,
 	dbkey.data = (void *) key;
 	dbkey.size = key_len;
 
-	if (pval != NULL) {
+	/* DB_THREAD handles can't return data in the internal buffer */
+	if (pval != NULL || tokukv->threaded) {
 		dbval.flags = DB_DBT_MALLOC;
 	}
 
@@ -225,11 +244,117 @@ nb_db_tokukv_select(struct nb_db *db, const void *key, size_t key_len,
 	if (pval) {
 		*pval = dbval.data;
 		*pval_len = dbval.size;
+	} else if (tokukv->threaded) {
+		free(dbval.data);
 	}
 
 	return 0;
 }
 
+struct nb_db_tokukv_buf {
+	void *data;
+	size_t size;
+	size_t len;
+};
+
+/* Called by getf_set() with the value in place */
+static int
+nb_db_tokukv_copy_val(DBT const *key, DBT const *val, void *extra)
+{
+	struct nb_db_tokukv_buf *buf = (struct nb_db_tokukv_buf *) extra;
+
+	(void) key;
+
+	buf->len = val->size;
+	memcpy(buf->data, val->data,
+	       val->size < buf->size ? val->size : buf->size);
+
+	return 0;
+}
+
+static int
+nb_db_tokukv_select_into(struct nb_db *db, const void *key, size_t key_len,
+			 void *buf, size_t buf_size, size_t *pval_len)
+{
+	struct nb_db_tokukv *tokukv = (struct nb_db_tokukv *) db;
+
+	DBT dbkey;
+	memset(&dbkey, 0, sizeof(dbkey));
+
+	dbkey.data = (void *) key;
+	dbkey.size = key_len;
+
+	struct nb_db_tokukv_buf val = {
+		.data = buf,
+		.size = buf_size,
+		.len = 0
+	};
+
+	int r = tokukv->db->getf_set(tokukv->db, NULL, 0, &dbkey,
+				     nb_db_tokukv_copy_val, &val);
+	if (r != 0) {
+		fprintf(stderr, "db->getf_set() failed: %s\n",
+			db_strerror(r));
+		return -1;
+	}
+
+	*pval_len = val.len;
+	return val.len > buf_size ? 1 : 0;
+}
+
+static int
+nb_db_tokukv_write_batch(struct nb_db *db, const struct nb_db_record *records,
+			 size_t count)
+{
+	struct nb_db_tokukv *tokukv = (struct nb_db_tokukv *) db;
+
+	int r;
+	DB_TXN *txn = NULL;
+	if (tokukv->transactional) {
+		r = tokukv->env->txn_begin(tokukv->env, NULL, &txn, 0);
+		if (r != 0) {
+			fprintf(stderr, "env->txn_begin() failed: %s\n",
+				db_strerror(r));
+			return -1;
+		}
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		DBT dbkey, dbval;
+		memset(&dbkey, 0, sizeof(dbkey));
+		memset(&dbval, 0, sizeof(dbval));
+
+		dbkey.data = (void *) records[i].key;
+		dbkey.size = records[i].key_len;
+		dbval.data = (void *) records[i].val;
+		dbval.size = records[i].val_len;
+
+		r = tokukv->db->put(tokukv->db, txn, &dbkey, &dbval, 0);
+		if (r != 0) {
+			fprintf(stderr, "db->put() failed: %s\n",
+				db_strerror(r));
+			goto error;
+		}
+	}
+
+	if (txn != NULL) {
+		r = txn->commit(txn, DB_TXN_NOSYNC);
+		if (r != 0) {
+			fprintf(stderr, "txn->commit() failed: %s\n",
+				db_strerror(r));
+			return -1;
+		}
+	}
+
+	return 0;
+
+error:
+	if (txn != NULL) {
+		txn->abort(txn);
+	}
+	return -1;
+}
+
 static void
 nb_db_tokukv_valfree(struct nb_db *db, void *val)
 {
@@ -237,6 +362,92 @@ nb_db_tokukv_valfree(struct nb_db *db, void *val)
 	free(val);
 }
 
+struct nb_db_tokukv_cursor {
+	DBC *dbc;
+	DBT key;
+	DBT val;
+	int started;
+};
+
+static struct nb_db_cursor *
+nb_db_tokukv_cursor_seek(struct nb_db *db, const void *key, size_t key_len)
+{
+	struct nb_db_tokukv *tokukv = (struct nb_db_tokukv *) db;
+
+	struct nb_db_tokukv_cursor *cursor = calloc(1, sizeof(*cursor));
+	if (cursor == NULL) {
+		fprintf(stderr, "malloc(%zu) failed", sizeof(*cursor));
+		goto error_1;
+	}
+
+	/* DB_SET_RANGE returns the found key in the same DBT */
+	cursor->key.data = malloc(key_len);
+	if (cursor->key.data == NULL) {
+		fprintf(stderr, "malloc(%zu) failed", key_len);
+		goto error_2;
+	}
+	memcpy(cursor->key.data, key, key_len);
+	cursor->key.size = key_len;
+	cursor->key.flags = DB_DBT_REALLOC;
+	cursor->val.flags = DB_DBT_REALLOC;
+
+	int r = tokukv->db->cursor(tokukv->db, NULL, &cursor->dbc, 0);
+	if (r != 0) {
+		fprintf(stderr, "db->cursor() failed: %s\n",
+			db_strerror(r));
+		goto error_3;
+	}
+
+	return (struct nb_db_cursor *) cursor;
+
+error_3:
+	free(cursor->key.data);
+error_2:
+	free(cursor);
+error_1:
+	return NULL;
+}
+
+static int
+nb_db_tokukv_cursor_next(struct nb_db_cursor *c,
+			  const void **pkey, size_t *pkey_len,
+			  const void **pval, size_t *pval_len)
+{
+	struct nb_db_tokukv_cursor *cursor =
+			(struct nb_db_tokukv_cursor *) c;
+
+	int flags = cursor->started ? DB_NEXT : DB_SET_RANGE;
+	cursor->started = 1;
+
+	int r = cursor->dbc->c_get(cursor->dbc, &cursor->key, &cursor->val,
+				   flags);
+	if (r == DB_NOTFOUND) {
+		return 1;
+	} else if (r != 0) {
+		fprintf(stderr, "dbc->get() failed: %s\n", db_strerror(r));
+		return -1;
+	}
+
+	*pkey = cursor->key.data;
+	*pkey_len = cursor->key.size;
+	*pval = cursor->val.data;
+	*pval_len = cursor->val.size;
+
+	return 0;
+}
+
+static void
+nb_db_tokukv_cursor_close(struct nb_db_cursor *c)
+{
+	struct nb_db_tokukv_cursor *cursor =
+			(struct nb_db_tokukv_cursor *) c;
+
+	cursor->dbc->c_close(cursor->dbc);
+	free(cursor->key.data);
+	free(cursor->val.data);
+	free(cursor);
+}
+
 static struct nb_db_if plugin = {
 	.name       = "tokukv",
 	.open       = nb_db_tokukv_open,
@@ -245,6 +456,11 @@ static struct nb_db_if plugin = {
 	.remove     = nb_db_tokukv_remove,
 	.select     = nb_db_tokukv_select,
 	.valfree    = nb_db_tokukv_valfree,
+	.select_into  = nb_db_tokukv_select_into,
+	.write_batch  = nb_db_tokukv_write_batch,
+	.cursor_seek  = nb_db_tokukv_cursor_seek,
+	.cursor_next  = nb_db_tokukv_cursor_next,
+	.cursor_close = nb_db_tokukv_cursor_close,
 };
 
 NB_DB_PLUGIN const struct nb_db_if *